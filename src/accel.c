@@ -0,0 +1,88 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include <math.h>
+#include <string.h>
+
+#include "accel.h"
+
+static const char *const profile_names[ACCEL_NUM_PROFILES] = {
+    [ACCEL_PROFILE_ADAPTIVE] = "adaptive",
+    [ACCEL_PROFILE_LINEAR] = "linear",
+    [ACCEL_PROFILE_FLAT] = "flat",
+};
+
+// the adaptive curve reaches the divisor bounds at these velocities, the
+// linear profile spans the same range
+#define ACCEL_SLOW_VELOCITY (1000.0 / pow(2.0 * ACCEL_MAX_DIVISOR, 1.0 / 0.7))
+#define ACCEL_FAST_VELOCITY (1000.0 / pow(2.0 * ACCEL_MIN_DIVISOR, 1.0 / 0.7))
+
+/* The profiles, velocity in units per msec to divisor, before clamping. */
+static double profile_adaptive(double velocity) {
+    return velocity <= 0.0 ? ACCEL_MAX_DIVISOR : pow(1000.0 / velocity, 0.7) * 0.5;
+}
+static double profile_linear(double velocity) {
+    double f = (velocity - ACCEL_SLOW_VELOCITY) / (ACCEL_FAST_VELOCITY - ACCEL_SLOW_VELOCITY);
+
+    return 1.0 / (1.0 / ACCEL_MAX_DIVISOR + f * (1.0 / ACCEL_MIN_DIVISOR - 1.0 / ACCEL_MAX_DIVISOR));
+}
+static double profile_flat(double velocity) {
+    return ACCEL_FLAT_DIVISOR;
+}
+static double (*const profile_funcs[ACCEL_NUM_PROFILES])(double velocity) = {
+    [ACCEL_PROFILE_ADAPTIVE] = profile_adaptive,
+    [ACCEL_PROFILE_LINEAR] = profile_linear,
+    [ACCEL_PROFILE_FLAT] = profile_flat,
+};
+
+void accel_init(struct AccelCurve *curve, enum AccelProfile profile) {
+    double divisor;
+    int i;
+
+    if (profile < 0 || profile >= ACCEL_NUM_PROFILES) {
+        profile = ACCEL_PROFILE_ADAPTIVE;
+    }
+    curve->profile = profile;
+    for (i = 0; i <= ACCEL_TABLE_SIZE; ++i) {
+        divisor = profile_funcs[profile](i * ACCEL_MAX_VELOCITY / ACCEL_TABLE_SIZE);
+        // a negative divisor would invert the motion
+        if (divisor > ACCEL_MAX_DIVISOR || divisor <= 0.0) {
+            divisor = ACCEL_MAX_DIVISOR;
+        } else if (divisor < ACCEL_MIN_DIVISOR) {
+            divisor = ACCEL_MIN_DIVISOR;
+        }
+        curve->divisor[i] = divisor;
+    }
+}
+/* -1 if there is no profile of that name. */
+int accel_profile_from_name(const char *name) {
+    int i;
+
+    for (i = 0; i < ACCEL_NUM_PROFILES; ++i) {
+        if (strcmp(name, profile_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+const char *accel_profile_name(enum AccelProfile profile) {
+    return profile >= 0 && profile < ACCEL_NUM_PROFILES ? profile_names[profile] : "unknown";
+}
@@ -0,0 +1,74 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Pointer acceleration: how many touchpad units make one pixel, depending
+ * on how fast the finger moves. The curve of the selected profile is
+ * sampled into a table once, the per-frame lookup only interpolates between
+ * two entries.
+ */
+
+#ifndef ACCEL_H
+#define ACCEL_H
+
+// the divisor of the slowest and of the fastest finger
+#define ACCEL_MAX_DIVISOR 25.0
+#define ACCEL_MIN_DIVISOR 5.0
+// the divisor of the flat profile at every speed
+#define ACCEL_FLAT_DIVISOR 15.0
+
+// the table covers 0 to ACCEL_MAX_VELOCITY touchpad units per msec, faster
+// fingers get its last entry; the adaptive and the linear profile are at
+// ACCEL_MIN_DIVISOR well before that
+#define ACCEL_MAX_VELOCITY 40.0
+#define ACCEL_TABLE_SIZE 2048
+
+enum AccelProfile {
+    ACCEL_PROFILE_ADAPTIVE, // pow(1 / velocity, 0.7), the curve the driver always had
+    ACCEL_PROFILE_LINEAR, // the gain grows linearly with the velocity
+    ACCEL_PROFILE_FLAT, // no acceleration, for precise work
+    ACCEL_NUM_PROFILES,
+};
+
+struct AccelCurve {
+    enum AccelProfile profile;
+    float divisor[ACCEL_TABLE_SIZE + 1]; // at i * ACCEL_MAX_VELOCITY / ACCEL_TABLE_SIZE
+};
+
+void accel_init(struct AccelCurve *curve, enum AccelProfile profile);
+int accel_profile_from_name(const char *name);
+const char *accel_profile_name(enum AccelProfile profile);
+
+/* The divisor for a finger that moved 'delta' units in 'dt' usec. */
+static inline double accel_divisor(const struct AccelCurve *curve, double delta, double dt) {
+    double pos;
+    int i;
+
+    if (delta <= 0.0) {
+        return curve->divisor[0];
+    }
+    pos = dt > 0.0 ? delta * (1000.0 * ACCEL_TABLE_SIZE / ACCEL_MAX_VELOCITY) / dt : ACCEL_TABLE_SIZE;
+    if (pos >= ACCEL_TABLE_SIZE) {
+        return curve->divisor[ACCEL_TABLE_SIZE];
+    }
+    i = (int) pos;
+    return curve->divisor[i] + (pos - i) * (curve->divisor[i + 1] - curve->divisor[i]);
+}
+
+#endif /* ACCEL_H */
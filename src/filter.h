@@ -0,0 +1,135 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Jitter filter of a finger position. A 1 euro filter (Casiez et al., CHI
+ * 2012) smooths each axis: a low-pass whose cutoff rises with the speed of
+ * the finger, so a slow finger is held steady and a fast one hardly lags.
+ * After it comes a deadzone for a finger at rest: once the finger was slow
+ * for FILTER_STILL_MS the output holds, until the smoothed position moves
+ * more than 'hysteresis' units away from it. From there the output moves
+ * with the finger again, offset by the deadzone, since only the motion
+ * counts. A resting finger wanders and rolls a little, that no longer
+ * trickles 1 pixel motion events, and a moving one is not slowed down.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <math.h>
+
+// Hz, the cutoff of the low-pass on the speed that steers the other cutoff
+#define FILTER_SPEED_CUTOFF 1.0
+// a finger rests once it moved less than the deadzone per this many msec,
+// for as long
+#define FILTER_STILL_MS 100
+
+struct AxisFilter {
+    double value; // smoothed position
+    double speed; // smoothed speed, units per second
+};
+
+struct PositionFilter {
+    int started; // 0 until the first position of the touch
+    int still; // the output holds while the finger stays in the deadzone
+    double slow; // seconds the finger has been slow enough to rest
+    int x; // the output
+    int y;
+    double offset_x; // of the output from the smoothed position
+    double offset_y;
+    struct AxisFilter axis_x;
+    struct AxisFilter axis_y;
+};
+
+static inline void filter_reset(struct PositionFilter *filter) {
+    filter->started = 0;
+}
+
+// the weight of a new sample in a low-pass with this cutoff
+static inline double filter_alpha(double cutoff, double dt) {
+    double t = 2.0 * M_PI * cutoff * dt;
+
+    return t / (t + 1.0);
+}
+
+static inline int filter_round(double value) {
+    return (int) (value >= 0.0 ? value + 0.5 : value - 0.5);
+}
+
+static inline void filter_smooth(struct AxisFilter *axis, int raw, double dt, double rate, double speed_alpha,
+                                 double min_cutoff, double beta) {
+    if (dt > 0.0) {
+        axis->speed += speed_alpha * ((raw - axis->value) * rate - axis->speed);
+    }
+    if (min_cutoff <= 0.0) {
+        axis->value = raw;
+    } else if (dt > 0.0) {
+        axis->value += filter_alpha(min_cutoff + beta * fabs(axis->speed), dt) * (raw - axis->value);
+    }
+}
+
+/* Feeds the position x/y, 'dt' seconds after the one before, and leaves
+ * the filtered one in filter->x/y. A touch starts at rest where it lands.
+ * min_cutoff (Hz) 0 turns the smoothing off and hysteresis 0 the deadzone,
+ * with both off the output is the input. */
+static inline void filter_position(struct PositionFilter *filter, int x, int y, double dt,
+                                   double min_cutoff, double beta, int hysteresis) {
+    double dx, dy, keep, rate, speed_alpha;
+
+    if (!filter->started) {
+        filter->started = 1;
+        filter->still = hysteresis > 0;
+        filter->slow = 0.0;
+        filter->x = x;
+        filter->y = y;
+        filter->axis_x.value = x;
+        filter->axis_y.value = y;
+        filter->axis_x.speed = 0.0;
+        filter->axis_y.speed = 0.0;
+        filter->offset_x = 0.0;
+        filter->offset_y = 0.0;
+        return;
+    }
+    rate = dt > 0.0 ? 1.0 / dt : 0.0;
+    speed_alpha = filter_alpha(FILTER_SPEED_CUTOFF, dt);
+    filter_smooth(&filter->axis_x, x, dt, rate, speed_alpha, min_cutoff, beta);
+    filter_smooth(&filter->axis_y, y, dt, rate, speed_alpha, min_cutoff, beta);
+    if (filter->still) {
+        dx = filter->axis_x.value - filter->x;
+        dy = filter->axis_y.value - filter->y;
+        if (dx * dx + dy * dy <= (double) hysteresis * hysteresis) {
+            return;
+        }
+        // the output only moves by as much as the finger left the deadzone
+        keep = hysteresis / sqrt(dx * dx + dy * dy);
+        filter->offset_x = dx * keep;
+        filter->offset_y = dy * keep;
+        filter->still = 0;
+        filter->slow = 0.0;
+    } else if (hysteresis > 0) {
+        dx = filter->axis_x.speed * FILTER_STILL_MS / 1000.0;
+        dy = filter->axis_y.speed * FILTER_STILL_MS / 1000.0;
+        filter->slow = dx * dx + dy * dy < (double) hysteresis * hysteresis ? filter->slow + dt : 0.0;
+        filter->still = filter->slow >= FILTER_STILL_MS / 1000.0;
+    }
+    filter->x = filter_round(filter->axis_x.value - filter->offset_x);
+    filter->y = filter_round(filter->axis_y.value - filter->offset_y);
+}
+
+#endif /* FILTER_H */
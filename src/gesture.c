@@ -0,0 +1,1517 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include <linux/input.h>
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "gesture.h"
+
+#define MAXINT INT_MAX
+
+#define GESTURE_CACHE_LINE 64
+
+_Static_assert(TS_NUM_STATES <= STATS_STATES, "struct GestureStats has no room for all states");
+
+
+#ifndef NDEBUG
+static int transitions_complete(void);
+#endif
+
+static size_t cache_line_align(size_t size) {
+    return (size + GESTURE_CACHE_LINE - 1) & ~(size_t) (GESTURE_CACHE_LINE - 1);
+}
+static void *take_storage(char **cursor, size_t size) {
+    void *ptr = *cursor;
+    *cursor += cache_line_align(size);
+    return ptr;
+}
+static void init_slot_index(struct SlotIndex *index, int num_slots, char **cursor) {
+    index->mask = take_storage(cursor, ((num_slots + 31) / 32) * sizeof(uint32_t));
+    index->ids = take_storage(cursor, num_slots * sizeof(int));
+    index->count = 0;
+}
+/* Returns 0 on success and -1 if the slot storage or the trace ring cannot
+ * be allocated. */
+int gesture_init(struct State *state, int num_slots, const struct GestureSink *sink, const struct GestureClock *clock) {
+    size_t slots_size, index_size, history_size;
+    char *cursor;
+    int f;
+
+    // a debug build checks the transition table, no input may be missing
+    assert(transitions_complete());
+    if (num_slots < 1) {
+        num_slots = 1;
+    }
+    slots_size = cache_line_align(num_slots * sizeof(struct Slot)) + cache_line_align(num_slots * sizeof(struct SlotShape));
+    index_size = cache_line_align(((num_slots + 31) / 32) * sizeof(uint32_t)) + cache_line_align(num_slots * sizeof(int));
+    history_size = cache_line_align(num_slots * sizeof(struct SlotHistory));
+    if (posix_memalign(&state->storage, GESTURE_CACHE_LINE, NUM_FRAMES * (slots_size + index_size) + index_size + history_size) != 0) {
+        state->storage = NULL;
+        return -1;
+    }
+    memset(state->storage, 0, NUM_FRAMES * (slots_size + index_size) + index_size + history_size);
+    cursor = state->storage;
+    for (f = 0; f < NUM_FRAMES; ++f) {
+        state->frames[f].slots = take_storage(&cursor, num_slots * sizeof(struct Slot));
+        state->frames[f].shapes = take_storage(&cursor, num_slots * sizeof(struct SlotShape));
+        init_slot_index(&state->frames[f].active, num_slots, &cursor);
+    }
+    init_slot_index(&state->dirty, num_slots, &cursor);
+    state->history = take_storage(&cursor, num_slots * sizeof(struct SlotHistory));
+    state->num_slots = num_slots;
+    state->sink = *sink;
+    state->clock = *clock;
+    state->features = 0;
+    state->coalescing = 0;
+    state->pending_dx = 0;
+    state->pending_dy = 0;
+    state->pending_scroll_dx = 0.0;
+    state->pending_scroll_dy = 0.0;
+    state->buttons = 0;
+    state->click_button = 0;
+    state->resyncs = 0;
+    state->stats = NULL;
+    if (trace_init(&state->trace, TRACE_LEVEL_OFF) != 0) {
+        free(state->storage);
+        state->storage = NULL;
+        return -1;
+    }
+    state->frame_events = 0;
+    timerclear(&state->input_time);
+    accel_init(&state->accel, ACCEL_PROFILE_ADAPTIVE);
+    gesture_default_config(&state->config);
+    clear_state(state);
+    return 0;
+}
+void gesture_free(struct State *state) {
+    trace_free(&state->trace);
+    free(state->storage);
+    state->storage = NULL;
+    state->num_slots = 0;
+}
+/* Starts counting into 'stats', NULL stops. Everything that counts checks
+ * state->stats first, so without it the engine does no extra work. */
+void gesture_set_stats(struct State *state, struct GestureStats *stats) {
+    struct timeval now;
+
+    state->stats = stats;
+    timerclear(&state->input_time);
+    if (stats) {
+        state->clock.now(state->clock.data, &now);
+        stats_add(&stats->started, now.tv_sec * 1000000ULL + now.tv_usec);
+    }
+}
+static void stats_update_time(struct State *state, struct timeval *time) {
+    __atomic_store_n(&state->stats->updated, time->tv_sec * 1000000ULL + time->tv_usec, __ATOMIC_RELAXED);
+}
+/* Counts a call to the sink, with the time since the input it answers. */
+static void stats_posted(struct State *state) {
+    struct timeval now;
+    long latency;
+
+    if (!state->stats) {
+        return;
+    }
+    stats_add(&state->stats->posted, 1);
+    if (timerisset(&state->input_time)) {
+        state->clock.now(state->clock.data, &now);
+        latency = usec_diff(&now, &state->input_time);
+        stats_record(&state->stats->latency_usec, latency > 0 ? latency : 0);
+    }
+}
+/* Rebuilds the acceleration table, takes effect with the next frame. */
+void gesture_set_accel_profile(struct State *state, enum AccelProfile profile) {
+    accel_init(&state->accel, profile);
+}
+void gesture_default_config(struct GestureConfig *config) {
+    config->tap_time = TAP_TIME_MS;
+    config->tap_move = TAP_MOVE;
+    config->scroll_divisor = SCROLL_DIVISOR;
+    config->scroll_axis_lock = SCROLL_AXIS_LOCK;
+    config->momentum_decay = MOMENTUM_DECAY;
+    config->momentum_delta_limit = MOMENTUM_DELTA_LIMIT;
+    config->drag_release = DRAG_RELEASE_MS;
+    config->scroll_release = SCROLL_RELEASE_MS;
+    config->filter_min_cutoff = FILTER_MIN_CUTOFF;
+    config->filter_beta = FILTER_BETA;
+    config->filter_hysteresis = FILTER_HYSTERESIS;
+    config->velocity_window = VELOCITY_WINDOW_MS;
+}
+/* 0 if the engine can work with these values, -1 if not. */
+int gesture_check_config(const struct GestureConfig *config) {
+    if (config->tap_time < 0 || config->tap_move < 0 ||
+        !(config->scroll_divisor > 0.0) ||
+        !(config->scroll_axis_lock >= 1.0) ||
+        !(config->momentum_decay > 0.0 && config->momentum_decay < 1.0) ||
+        !(config->momentum_delta_limit > 0.0) ||
+        config->drag_release < 0 || config->scroll_release < 0 ||
+        !(config->filter_min_cutoff >= 0.0) || !(config->filter_beta >= 0.0) ||
+        config->filter_hysteresis < 0 || config->velocity_window < 0) {
+        return -1;
+    }
+    return 0;
+}
+/* Replaces the whole configuration at once, or nothing if it is not valid.
+ * Call it between frames, a glide or release already running keeps its
+ * timing. */
+int gesture_set_config(struct State *state, const struct GestureConfig *config) {
+    if (gesture_check_config(config) != 0) {
+        return -1;
+    }
+    state->config = *config;
+    return 0;
+}
+static void dispatch(struct State *state, enum GestureInput input, struct timeval *time);
+/* The pending timeouts are a binary min-heap on their deadline in
+ * state->deadlines, state->deadline_pos[timer] is where each one is or -1.
+ * The clock's one timer is always armed for the root. */
+static void swap_deadlines(struct State *state, int i, int j) {
+    struct GestureDeadline tmp = state->deadlines[i];
+
+    state->deadlines[i] = state->deadlines[j];
+    state->deadlines[j] = tmp;
+    state->deadline_pos[state->deadlines[i].timer] = i;
+    state->deadline_pos[state->deadlines[j].timer] = j;
+}
+static void sift_deadline(struct State *state, int i) {
+    int child;
+
+    while (i > 0 && timercmp(&state->deadlines[i].at, &state->deadlines[(i - 1) / 2].at, <)) {
+        swap_deadlines(state, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < state->num_deadlines) {
+        if (child + 1 < state->num_deadlines && timercmp(&state->deadlines[child + 1].at, &state->deadlines[child].at, <)) {
+            child++;
+        }
+        if (!timercmp(&state->deadlines[child].at, &state->deadlines[i].at, <)) {
+            break;
+        }
+        swap_deadlines(state, i, child);
+        i = child;
+    }
+}
+static void remove_deadline(struct State *state, enum GestureTimer timer) {
+    int i = state->deadline_pos[timer];
+
+    if (i < 0) {
+        return;
+    }
+    state->deadline_pos[timer] = -1;
+    if (i != --state->num_deadlines) {
+        state->deadlines[i] = state->deadlines[state->num_deadlines];
+        state->deadline_pos[state->deadlines[i].timer] = i;
+        sift_deadline(state, i);
+    }
+}
+static void arm_clock(struct State *state) {
+    struct timeval now;
+    long millis;
+
+    if (state->num_deadlines == 0) {
+        state->clock.cancel_timer(state->clock.data);
+        return;
+    }
+    state->clock.now(state->clock.data, &now);
+    millis = (usec_diff(&state->deadlines[0].at, &now) + 999) / 1000;
+    // 0 would disarm an X server timer
+    state->clock.set_timer(state->clock.data, millis < 1 ? 1 : millis);
+}
+/* Runs timer's function in 'millis' ms, replacing its pending deadline. */
+static void set_timer(struct State *state, enum GestureTimer timer, int millis) {
+    struct timeval now, interval;
+    int i;
+
+    remove_deadline(state, timer);
+    state->clock.now(state->clock.data, &now);
+    interval.tv_sec = millis / 1000;
+    interval.tv_usec = (millis % 1000) * 1000;
+    i = state->num_deadlines++;
+    timeradd(&now, &interval, &state->deadlines[i].at);
+    state->deadlines[i].timer = timer;
+    state->deadline_pos[timer] = i;
+    sift_deadline(state, i);
+    arm_clock(state);
+}
+static void cancel_timer(struct State *state, enum GestureTimer timer) {
+    if (state->deadline_pos[timer] >= 0) {
+        remove_deadline(state, timer);
+        arm_clock(state);
+    }
+}
+static void clear_timers(struct State *state) {
+    int timer;
+
+    state->num_deadlines = 0;
+    for (timer = 0; timer < GESTURE_NUM_TIMERS; ++timer) {
+        state->deadline_pos[timer] = -1;
+    }
+}
+// while coalescing, motion and scroll are added up and posted when the
+// other kind comes in, before a button, and at gesture_coalesce_end()
+// every call to the sink goes through these, for the stats and the trace
+static void sink_motion(struct State *state, int dx, int dy) {
+    stats_posted(state);
+    trace_record(&state->trace, TRACE_LEVEL_POSTED, TRACE_MOTION, 0, dx, dy, 0, 0);
+    state->sink.motion(state->sink.data, dx, dy);
+}
+static void sink_scroll(struct State *state, double dx, double dy) {
+    stats_posted(state);
+    trace_record(&state->trace, TRACE_LEVEL_POSTED, TRACE_SCROLL, 0, lround(dx * 1000), lround(dy * 1000), 0, 0);
+    state->sink.scroll(state->sink.data, dx, dy);
+}
+static void sink_button(struct State *state, int button, int is_press) {
+    stats_posted(state);
+    trace_record(&state->trace, TRACE_LEVEL_POSTED, TRACE_BUTTON, 0, button, is_press, 0, 0);
+    state->sink.button(state->sink.data, button, is_press);
+}
+static void flush_motion(struct State *state) {
+    if (state->pending_dx != 0 || state->pending_dy != 0) {
+        sink_motion(state, state->pending_dx, state->pending_dy);
+    }
+    state->pending_dx = 0;
+    state->pending_dy = 0;
+}
+static void flush_scroll(struct State *state) {
+    if (state->pending_scroll_dx != 0.0 || state->pending_scroll_dy != 0.0) {
+        sink_scroll(state, state->pending_scroll_dx, state->pending_scroll_dy);
+    }
+    state->pending_scroll_dx = 0.0;
+    state->pending_scroll_dy = 0.0;
+}
+static void post_motion(struct State *state, int dx, int dy) {
+    if (!state->coalescing) {
+        sink_motion(state, dx, dy);
+        return;
+    }
+    flush_scroll(state);
+    state->pending_dx += dx;
+    state->pending_dy += dy;
+}
+static void post_scroll(struct State *state, double dx, double dy) {
+    if (!state->coalescing) {
+        sink_scroll(state, dx, dy);
+        return;
+    }
+    flush_motion(state);
+    state->pending_scroll_dx += dx;
+    state->pending_scroll_dy += dy;
+}
+// all buttons go out through here so the engine knows which ones are held;
+// the physical button and a gesture can both want the same one, it is
+// pressed once and released by whichever lets go first
+static void post_button(struct State *state, int button, int is_press) {
+    if (!(state->buttons & (1u << button)) == !is_press) {
+        return;
+    }
+    flush_motion(state);
+    flush_scroll(state);
+    if (is_press) {
+        state->buttons |= 1u << button;
+    } else {
+        state->buttons &= ~(1u << button);
+    }
+    sink_button(state, button, is_press);
+}
+static void release_buttons(struct State *state) {
+    int button;
+
+    for (button = MOUSE_LEFT_BUTTON; button <= MOUSE_HORIZONTAL_WHEEL_2_BUTTON; ++button) {
+        if (state->buttons & (1u << button)) {
+            post_button(state, button, 0);
+        }
+    }
+}
+/* Runs every timeout that is due and arms the clock for the next one. */
+void gesture_timer_expired(struct State *state) {
+    struct timeval now;
+    enum GestureTimer timer;
+
+    state->clock.now(state->clock.data, &now);
+    state->trace.now = now.tv_sec * 1000000ULL + now.tv_usec;
+    if (state->stats) {
+        // what the timeouts post answers no input
+        timerclear(&state->input_time);
+        stats_update_time(state, &now);
+    }
+    while (state->num_deadlines > 0 && !timercmp(&now, &state->deadlines[0].at, <)) {
+        timer = state->deadlines[0].timer;
+        remove_deadline(state, timer);
+        trace_record(&state->trace, TRACE_LEVEL_FRAMES, TRACE_TIMER, 0, timer, 0, 0, 0);
+        dispatch(state, GESTURE_INPUT_TIMER + timer, &now);
+    }
+    arm_clock(state);
+}
+
+const char *type_and_code_name(int type, int code) {
+    switch (type) {
+        case EV_SYN:
+        return "EV_SYN";
+        break;
+        case EV_KEY:
+        switch (code) {
+            case BTN_LEFT:
+            return "EV_KEY BTN_LEFT";
+            break;
+            case BTN_TOOL_FINGER:
+            return "EV_KEY BTN_TOOL_FINGER";
+            break;
+            case BTN_TOOL_QUINTTAP:
+            return "EV_KEY BTN_TOOL_QUINTTAP";
+            break;
+            case BTN_TOUCH:
+            return "EV_KEY BTN_TOUCH";
+            break;
+            case BTN_TOOL_DOUBLETAP:
+            return "EV_KEY BTN_TOOL_DOUBLETAP";
+            break;
+            case BTN_TOOL_TRIPLETAP:
+            return "EV_KEY BTN_TOOL_TRIPLETAP";
+            break;
+            case BTN_TOOL_QUADTAP:
+            return "EV_KEY BTN_TOOL_QUADTAP";
+            break;
+        }
+        break;
+        case EV_ABS:
+        switch (code) {
+            case ABS_X:
+            return "EV_ABS ABS_X";
+            break;
+            case ABS_Y:
+            return "EV_ABS ABS_Y";
+            break;
+            case ABS_PRESSURE:
+            return "EV_ABS ABS_PRESSURE";
+            break;
+            case ABS_TOOL_WIDTH:
+            return "EV_ABS ABS_TOOL_WIDTH";
+            break;
+            case ABS_MT_SLOT:
+            return "EV_ABS ABS_MT_SLOT";
+            break;
+            case ABS_MT_TOUCH_MAJOR:
+            return "EV_ABS ABS_MT_TOUCH_MAJOR";
+            break;
+            case ABS_MT_TOUCH_MINOR:
+            return "EV_ABS ABS_MT_TOUCH_MINOR";
+            break;
+            case ABS_MT_WIDTH_MAJOR:
+            return "EV_ABS ABS_MT_WIDTH_MAJOR";
+            break;
+            case ABS_MT_WIDTH_MINOR:
+            return "EV_ABS ABS_MT_WIDTH_MINOR";
+            break;
+            case ABS_MT_ORIENTATION:
+            return "EV_ABS ABS_MT_ORIENTATION";
+            break;
+            case ABS_MT_POSITION_X:
+            return "EV_ABS ABS_MT_POSITION_X";
+            break;
+            case ABS_MT_POSITION_Y:
+            return "EV_ABS ABS_MT_POSITION_Y";
+            break;
+            case ABS_MT_TRACKING_ID:
+            return "EV_ABS ABS_MT_TRACKING_ID";
+            break;
+        }
+        break;
+    }
+    return "undefined";
+}
+const char *touchpad_state_name(enum TouchpadStates state) {
+    switch (state) {
+        case TS_DEFAULT:
+        return "TS_DEFAULT";
+        break;
+        case TS_2_FINGER_SCROLL:
+        return "TS_2_FINGER_SCROLL";
+        break;
+        case TS_2_FINGER_SCROLL_RELEASING:
+        return "TS_2_FINGER_SCROLL_RELEASING";
+        break;
+        case TS_2_FINGER_SCROLL_MOMENTUM:
+        return "TS_2_FINGER_SCROLL_MOMENTUM";
+        break;
+        case TS_3_FINGER_DRAG:
+        return "TS_3_FINGER_DRAG";
+        break;
+        case TS_3_FINGER_DRAG_RELEASING:
+        return "TS_3_FINGER_DRAG_RELEASING";
+        break;
+        case TS_NUM_STATES:
+        break;
+    }
+    return "undefined";
+}
+time_t usec_diff(struct timeval *end, struct timeval *start) {
+    return (end->tv_sec - start->tv_sec) * 1000000 + ((int) end->tv_usec - (int) start->tv_usec);
+}
+void calculate_elapsed_useconds_and_active_slots(struct State *state, struct timeval *time) {
+    int i;
+    struct Slot *slot;
+    // inactive slots keep the 0 clear_slot() left in elapsed_useconds
+    state->active_slots = state->active->count;
+    for (i = 0; i < state->active->count; ++i) {
+        slot = &state->slots[state->active->ids[i]];
+        slot->elapsed_useconds = usec_diff(time, &slot->start_time);
+    }
+}
+/* Runs the position of every finger through its jitter filter into fx/fy,
+ * see filter.h. A finger that just landed starts where it is. */
+void filter_slots(struct State *state) {
+    const struct GestureConfig *config = &state->config;
+    struct Slot *slot;
+    double dt;
+    int i, slot_id;
+
+    for (i = 0; i < state->active->count; ++i) {
+        slot_id = state->active->ids[i];
+        slot = &state->slots[slot_id];
+        dt = (slot->elapsed_useconds - state->prev_slots[slot_id].elapsed_useconds) / 1000000.0;
+        if (slot->x == MAXINT || slot->y == MAXINT) {
+            // not both known yet, nothing to filter
+            slot->fx = slot->x;
+            slot->fy = slot->y;
+            continue;
+        }
+        filter_position(&slot->filter, slot->x, slot->y, dt, config->filter_min_cutoff,
+                        config->filter_beta, config->filter_hysteresis);
+        slot->fx = slot->filter.x;
+        slot->fy = slot->filter.y;
+    }
+}
+/* The least squares line through the positions of the last 'window' usec,
+ * and always the one before the newest, gives the velocity in units per
+ * second. Times and positions are taken relative to the newest, which
+ * keeps the sums small. */
+static void fit_velocity(const struct SlotHistory *history, long window, double *vx, double *vy) {
+    double t, x, y, st = 0.0, sx = 0.0, sy = 0.0, stt = 0.0, stx = 0.0, sty = 0.0, denom;
+    int i, idx, newest = (history->head - 1) & (HISTORY_SIZE - 1), n = 0;
+
+    for (i = 0; i < history->count; ++i) {
+        idx = (history->head - 1 - i) & (HISTORY_SIZE - 1);
+        if (i >= 2 && history->t[newest] - history->t[idx] > window) {
+            break;
+        }
+        t = (history->t[idx] - history->t[newest]) / 1000000.0;
+        x = history->x[idx] - history->x[newest];
+        y = history->y[idx] - history->y[newest];
+        st += t;
+        sx += x;
+        sy += y;
+        stt += t * t;
+        stx += t * x;
+        sty += t * y;
+        n++;
+    }
+    denom = n * stt - st * st;
+    if (n < 2 || denom <= 0.0) {
+        // one position, or all of the same time
+        *vx = 0.0;
+        *vy = 0.0;
+        return;
+    }
+    *vx = (n * stx - st * sx) / denom;
+    *vy = (n * sty - st * sy) / denom;
+}
+/* Adds the position of every finger to its history and fits its velocity
+ * over the last config.velocity_window msec, so a single noisy frame does
+ * not decide how fast the pointer goes or how long a scroll glides. A
+ * finger that just landed starts a new history. */
+void estimate_velocities(struct State *state) {
+    struct SlotHistory *history;
+    struct Slot *slot;
+    int i, slot_id;
+
+    for (i = 0; i < state->active->count; ++i) {
+        slot_id = state->active->ids[i];
+        slot = &state->slots[slot_id];
+        history = &state->history[slot_id];
+        if (slot->x == MAXINT || slot->y == MAXINT) {
+            continue;
+        }
+        // a new touch, also one that replaced the old in the same frame
+        if (!state->prev_slots[slot_id].active ||
+            (history->count > 0 && slot->elapsed_useconds < history->t[(history->head - 1) & (HISTORY_SIZE - 1)])) {
+            history->count = 0;
+        }
+        history->t[history->head] = slot->elapsed_useconds;
+        history->x[history->head] = slot->x;
+        history->y[history->head] = slot->y;
+        history->head = (history->head + 1) & (HISTORY_SIZE - 1);
+        if (history->count < HISTORY_SIZE) {
+            history->count++;
+        }
+        fit_velocity(history, state->config.velocity_window * 1000L, &slot->vx, &slot->vy);
+    }
+}
+static void set_frame_pointers(struct State *state) {
+    struct Frame *frame = &state->frames[state->frame];
+    struct Frame *prev_frame = &state->frames[(state->frame + NUM_FRAMES - 1) % NUM_FRAMES];
+    state->slots = frame->slots;
+    state->shapes = frame->shapes;
+    state->active = &frame->active;
+    state->prev_slots = prev_frame->slots;
+    state->prev_active = &prev_frame->active;
+}
+void clear_state(struct State *state) {
+    int i, f;
+    state->current_slot_id = 0;
+    state->active_slots = 0;
+    state->prev_active_slots = 0;
+    state->touchpad_state = TS_DEFAULT;
+    state->touchpad_state_updated_at.tv_sec = 0;
+    state->touchpad_state_updated_at.tv_usec = 0;
+    clear_timers(state);
+    clear_slot(&state->momentum_slot1);
+    clear_slot(&state->momentum_slot2);
+    for (f = 0; f < NUM_FRAMES; ++f) {
+        for (i = 0; i < state->num_slots; ++i) {
+            clear_slot(&state->frames[f].slots[i]);
+            clear_slot_shape(&state->frames[f].shapes[i]);
+        }
+        clear_slot_index(&state->frames[f].active);
+    }
+    clear_slot_index(&state->dirty);
+    for (i = 0; i < state->num_slots; ++i) {
+        state->history[i].count = 0;
+    }
+    state->frame = 0;
+    set_frame_pointers(state);
+}
+void clear_slot(struct Slot *slot) {
+    slot->active = 0;
+    slot->x = MAXINT;
+    slot->y = MAXINT;
+    slot->pressure = 0;
+
+    slot->start_time.tv_sec = 0;
+    slot->start_time.tv_usec = 0;
+    slot->elapsed_useconds = 0;
+    slot->no_tap = 0;
+
+    slot->startx = MAXINT;
+    slot->starty = MAXINT;
+
+    slot->ddx = 0.0;
+    slot->ddy = 0.0;
+    slot->delta_ddx = 0.0;
+    slot->delta_ddy = 0.0;
+    slot->dx = 0;
+    slot->dy = 0;
+    slot->total_dx = 0;
+    slot->total_dy = 0;
+    slot->tap_ddx = 0.0;
+    slot->tap_ddy = 0.0;
+
+    slot->fx = MAXINT;
+    slot->fy = MAXINT;
+    filter_reset(&slot->filter);
+    slot->vx = 0.0;
+    slot->vy = 0.0;
+}
+void clear_slot_shape(struct SlotShape *shape) {
+    shape->touch_major = 0;
+    shape->touch_minor = 0;
+    shape->width_major = 0;
+    shape->width_minor = 0;
+    shape->orientation = 0;
+}
+void clear_slot_index(struct SlotIndex *index) {
+    int i;
+    for (i = 0; i < index->count; ++i) {
+        index->mask[index->ids[i] / 32] = 0;
+    }
+    index->count = 0;
+}
+void add_to_slot_index(struct SlotIndex *index, int slot_id) {
+    int i;
+    uint32_t bit = 1u << (slot_id % 32);
+    if (index->mask[slot_id / 32] & bit) {
+        return;
+    }
+    index->mask[slot_id / 32] |= bit;
+    // keep ids sorted, there are only a handful of them
+    for (i = index->count; i > 0 && index->ids[i - 1] > slot_id; --i) {
+        index->ids[i] = index->ids[i - 1];
+    }
+    index->ids[i] = slot_id;
+    index->count++;
+}
+void remove_from_slot_index(struct SlotIndex *index, int slot_id) {
+    int i;
+    uint32_t bit = 1u << (slot_id % 32);
+    if (!(index->mask[slot_id / 32] & bit)) {
+        return;
+    }
+    index->mask[slot_id / 32] &= ~bit;
+    for (i = 0; index->ids[i] != slot_id; ++i) {
+    }
+    for (; i < index->count - 1; ++i) {
+        index->ids[i] = index->ids[i + 1];
+    }
+    index->count--;
+}
+void copy_slot_index(struct SlotIndex *dst, const struct SlotIndex *src) {
+    int i;
+    clear_slot_index(dst);
+    for (i = 0; i < src->count; ++i) {
+        dst->mask[src->ids[i] / 32] = src->mask[src->ids[i] / 32];
+    }
+    memcpy(dst->ids, src->ids, src->count * sizeof(src->ids[0]));
+    dst->count = src->count;
+}
+void activate_current_slot(struct State *state, struct timeval *time) {
+    state->slots[state->current_slot_id].active = 1;
+    add_to_slot_index(state->active, state->current_slot_id);
+    if (state->slots[state->current_slot_id].start_time.tv_sec == 0) {
+        state->slots[state->current_slot_id].start_time = *time;
+    }
+}
+void deactivate_current_slot(struct State *state) {
+    clear_slot(&state->slots[state->current_slot_id]);
+    clear_slot_shape(&state->shapes[state->current_slot_id]);
+    remove_from_slot_index(state->active, state->current_slot_id);
+}
+int get_active_slot_id(struct SlotIndex *index) {
+    if (index->count > 0) {
+        return index->ids[0];
+    }
+    return -1;
+}
+void get_2_active_slots(struct Slot slots[], struct SlotIndex *index, struct Slot **slot1, struct Slot **slot2) {
+    *slot1 = index->count > 0 ? &slots[index->ids[0]] : NULL;
+    *slot2 = index->count > 1 ? &slots[index->ids[1]] : NULL;
+}
+void get_3_active_slots(struct Slot slots[], struct SlotIndex *index, struct Slot **slot1, struct Slot **slot2, struct Slot **slot3) {
+    *slot1 = index->count > 0 ? &slots[index->ids[0]] : NULL;
+    *slot2 = index->count > 1 ? &slots[index->ids[1]] : NULL;
+    *slot3 = index->count > 2 ? &slots[index->ids[2]] : NULL;
+}
+int is_tap_click(struct State *state, struct Slot *slot) {
+    if (!slot->active || slot->no_tap) {
+        return 0;
+    }
+    if (slot->elapsed_useconds > state->config.tap_time * 1000) {
+        return 0;
+    }
+    if (slot->total_dx > state->config.tap_move || slot->total_dy > state->config.tap_move) {
+        return 0;
+    }
+    return 1;
+}
+void set_start_fields_if_not_set(struct Slot *slot, struct timeval *time) {
+    if (!slot->active) {
+        return;
+    }
+    if (slot->startx == MAXINT) {
+        slot->startx = slot->x;
+    }
+    if (slot->starty == MAXINT) {
+        slot->starty = slot->y;
+    }
+}
+/* Moves the sub-pixel accumulators (ddx/ddy) of a finger by one frame and
+ * takes the whole pixels out into dx/dy. The pointer follows the filtered
+ * position, the tap movement in total_dx/total_dy the raw one: a quick
+ * short stroke stays in the filter's deadzone but is no tap. */
+void calculate_dx_dy(struct State *state, struct Slot *slot, struct Slot *prev_slot, struct timeval *time) {
+    double move_x, move_y, raw_x, raw_y, delta, speed;
+    int has_x, has_y, tap_dx, tap_dy;
+
+    if (!slot->active) {
+        return;
+    }
+    has_x = slot->fx != MAXINT && prev_slot->fx != MAXINT;
+    has_y = slot->fy != MAXINT && prev_slot->fy != MAXINT;
+    move_x = has_x ? slot->fx - prev_slot->fx : 0.0;
+    move_y = has_y ? slot->fy - prev_slot->fy : 0.0;
+    raw_x = has_x ? slot->x - prev_slot->x : 0.0;
+    raw_y = has_y ? slot->y - prev_slot->y : 0.0;
+    // the speed is the fitted one, per second; a missing coordinate counts
+    // as a jump, that gives the slowest speed
+    delta = has_x && has_y ? fabs(slot->vx) + fabs(slot->vy) : (double) MAXINT;
+    speed = accel_divisor(&state->accel, delta, 1000000.0);
+
+    // sudden change in pressure, the user releasing the touchpad
+    if (abs(slot->pressure - prev_slot->pressure) > 20 || slot->elapsed_useconds < 15000) {
+        slot->ddx = 0.0;
+        slot->ddy = 0.0;
+        slot->tap_ddx = 0.0;
+        slot->tap_ddy = 0.0;
+    } else {
+        slot->ddx += move_x / speed;
+        slot->ddy += move_y / speed;
+        slot->tap_ddx += raw_x / speed;
+        slot->tap_ddy += raw_y / speed;
+    }
+    if (has_x) {
+        slot->dx = (int) slot->ddx;
+        slot->ddx -= slot->dx;
+        tap_dx = (int) slot->tap_ddx;
+        slot->total_dx += abs(tap_dx);
+        slot->tap_ddx -= tap_dx;
+    }
+    if (has_y) {
+        slot->dy = (int) slot->ddy;
+        slot->ddy -= slot->dy;
+        tap_dy = (int) slot->tap_ddy;
+        slot->total_dy += abs(tap_dy);
+        slot->tap_ddy -= tap_dy;
+    }
+}
+void update_touchpad_state(struct State *state, enum TouchpadStates new_state, struct timeval *time) {
+    update_touchpad_state_msg(state, new_state, time, NULL);
+}
+void update_touchpad_state_msg(struct State *state, enum TouchpadStates new_state, struct timeval *time, const char *msg) {
+    if (state->touchpad_state != new_state) {
+        trace_record(&state->trace, TRACE_LEVEL_STATE, TRACE_STATE, 0,
+                state->touchpad_state, new_state, trace_string(&state->trace, msg), 0);
+        if (state->stats) {
+            // the first state after clear_state() has no start time
+            if (timerisset(&state->touchpad_state_updated_at)) {
+                stats_add(&state->stats->state_usec[state->touchpad_state], usec_diff(time, &state->touchpad_state_updated_at));
+            }
+            stats_add(&state->stats->state_entries[new_state], 1);
+        }
+        state->touchpad_state = new_state;
+        state->touchpad_state_updated_at = *time;
+    }
+}
+/* The gesture state machine: what a frame or a timeout does depends only on
+ * the state and the input, see transitions[]. A state can have actions
+ * that run whenever it is entered or left, whatever the transition. */
+struct Transition;
+typedef void (*GestureAction)(struct State *state, const struct Transition *t, struct timeval *time);
+struct Transition {
+    GestureAction action;
+    enum TouchpadStates next; // the state the action goes to, if it does, or BY_ACTION
+    const char *msg; // for the trace
+};
+// the action of the row picks one of several states itself
+#define BY_ACTION TS_NUM_STATES
+static void start_scroll_momentum(struct State *state, struct timeval *time);
+static void enter_scroll_releasing(struct State *state, struct timeval *time) {
+    set_timer(state, GESTURE_TIMER_SCROLL_RELEASE, state->config.scroll_release);
+}
+static void leave_scroll_releasing(struct State *state) {
+    cancel_timer(state, GESTURE_TIMER_SCROLL_RELEASE);
+}
+/* The glide starts with the velocity lift_scroll() left in momentum_slot1. */
+static void enter_scroll_momentum(struct State *state, struct timeval *time) {
+    trace_record(&state->trace, TRACE_LEVEL_STATE, TRACE_MOMENTUM, 0,
+            lround(state->momentum_slot1.delta_ddx * 1000), lround(state->momentum_slot1.delta_ddy * 1000), 0, 0);
+    start_scroll_momentum(state, time);
+}
+static void leave_scroll_momentum(struct State *state) {
+    cancel_timer(state, GESTURE_TIMER_SCROLL_MOMENTUM);
+}
+static void enter_drag_releasing(struct State *state, struct timeval *time) {
+    set_timer(state, GESTURE_TIMER_DRAG_RELEASE, state->config.drag_release);
+}
+static void leave_drag_releasing(struct State *state) {
+    cancel_timer(state, GESTURE_TIMER_DRAG_RELEASE);
+}
+static const struct {
+    void (*enter)(struct State *state, struct timeval *time);
+    void (*leave)(struct State *state);
+} state_actions[TS_NUM_STATES] = {
+    [TS_2_FINGER_SCROLL_RELEASING] = { enter_scroll_releasing, leave_scroll_releasing },
+    [TS_2_FINGER_SCROLL_MOMENTUM] = { enter_scroll_momentum, leave_scroll_momentum },
+    [TS_3_FINGER_DRAG_RELEASING] = { enter_drag_releasing, leave_drag_releasing },
+};
+static void transition(struct State *state, enum TouchpadStates next, struct timeval *time, const char *msg) {
+    enum TouchpadStates prev = state->touchpad_state;
+
+    if (prev == next) {
+        return;
+    }
+    if (state_actions[prev].leave) {
+        state_actions[prev].leave(state);
+    }
+    update_touchpad_state_msg(state, next, time, msg);
+    if (state_actions[next].enter) {
+        state_actions[next].enter(state, time);
+    }
+}
+/* The frame with its active slots, at TRACE_LEVEL_FRAMES. */
+static void trace_frame(struct State *state) {
+    struct Slot *slot;
+    int i;
+
+    if (!trace_enabled(&state->trace, TRACE_LEVEL_FRAMES)) {
+        return;
+    }
+    trace_record(&state->trace, TRACE_LEVEL_FRAMES, TRACE_FRAME, 0,
+            state->active_slots, state->prev_active_slots, state->touchpad_state, 0);
+    for (i = 0; i < state->active->count; ++i) {
+        slot = &state->slots[state->active->ids[i]];
+        trace_record(&state->trace, TRACE_LEVEL_FRAMES, TRACE_SLOT, state->active->ids[i],
+                slot->x, slot->y, slot->pressure, slot->elapsed_useconds / 1000);
+    }
+}
+/* Scrolls and goes to 'next'; the glide passes the state it is in. */
+void do_scrolling(struct State *state, struct Slot *slot1, struct Slot *slot2, struct timeval *time, enum TouchpadStates next) {
+    double dx, dy;
+
+    slot1->ddx += slot1->delta_ddx;
+    slot1->ddy += slot1->delta_ddy;
+    slot2->ddx = slot1->ddx;
+    slot2->ddy = slot1->ddy;
+    // the fingers have to move a whole wheel click before scrolling starts,
+    // from then on every fraction goes out in the frame it belongs to
+    if (state->touchpad_state != next && fabs(slot1->ddx) < 1.0 && fabs(slot1->ddy) < 1.0) {
+        return;
+    }
+    dx = slot1->ddx;
+    dy = slot1->ddy;
+    slot1->ddx = slot2->ddx = 0.0;
+    slot1->ddy = slot2->ddy = 0.0;
+    if (dx == 0.0 && dy == 0.0) {
+        return;
+    }
+    transition(state, next, time, NULL);
+    post_scroll(state, dx, dy);
+}
+void handle_2_finger_scroll(struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *prev_slot1, struct Slot *prev_slot2, struct timeval *time, enum TouchpadStates next) {
+    int x, y, prevx, prevy;
+    set_start_fields_if_not_set(slot1, time);
+    set_start_fields_if_not_set(slot2, time);
+    x = (slot1->x + slot2->x) / 2;
+    y = (slot1->y + slot2->y) / 2;
+    prevx = (prev_slot1->x + prev_slot2->x) / 2;
+    prevy = (prev_slot1->y + prev_slot2->y) / 2;
+    slot1->delta_ddx = (x - prevx) / state->config.scroll_divisor;
+    slot1->delta_ddy = (y - prevy) / state->config.scroll_divisor;
+    if (fabs(slot1->delta_ddx) > state->config.scroll_axis_lock * fabs(slot1->delta_ddy)) {
+        slot1->delta_ddy = 0;
+    }
+    if (fabs(slot1->delta_ddy) > state->config.scroll_axis_lock * fabs(slot1->delta_ddx)) {
+        slot1->delta_ddx = 0;
+    }
+    do_scrolling(state, slot1, slot2, time, next);
+}
+void handle_3_finger_drag(struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *slot3, struct Slot *prev_slot1, struct Slot *prev_slot2, struct Slot *prev_slot3, struct timeval *time, enum TouchpadStates next) {
+    int dx, dy;
+    set_start_fields_if_not_set(slot1, time);
+    set_start_fields_if_not_set(slot2, time);
+    set_start_fields_if_not_set(slot3, time);
+    calculate_dx_dy(state, slot1, prev_slot1, time);
+    calculate_dx_dy(state, slot2, prev_slot2, time);
+    calculate_dx_dy(state, slot3, prev_slot3, time);
+    dx = round((slot1->dx + slot2->dx + slot3->dx) / 3.0);
+    dy = round((slot1->dy + slot2->dy + slot3->dy) / 3.0);
+    if (dx != 0 || dy != 0) {
+        if (state->touchpad_state != next) {
+            transition(state, next, time, NULL);
+            post_button(state, MOUSE_LEFT_BUTTON, 1);
+        }
+        post_motion(state, dx, dy);
+    }
+}
+/* How far the momentum has scrolled 'elapsed' usec after it started, in
+ * units of its starting velocity. The velocity decays by 'decay' every
+ * MOMENTUM_TICK_MS, and the first step goes out right at the start. */
+static double momentum_progress(double decay, long elapsed) {
+    return (1.0 - pow(decay, elapsed / (MOMENTUM_TICK_MS * 1000.0) + 1.0)) / (1.0 - decay);
+}
+static void timerfunc_scroll_momentum(struct State *state) {
+    struct timeval time;
+    double decay = state->momentum_decay;
+    double progress, speed;
+    long elapsed;
+    int millis, remaining;
+
+    state->clock.now(state->clock.data, &time);
+    elapsed = usec_diff(&time, &state->momentum_start);
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+    // stop early when what is left would not even scroll a pixel
+    if (elapsed >= state->momentum_duration ||
+            state->momentum_speed * (momentum_progress(decay, state->momentum_duration) - momentum_progress(decay, elapsed)) < MOMENTUM_MIN_SCROLL) {
+        elapsed = state->momentum_duration;
+    }
+    progress = momentum_progress(decay, elapsed);
+    if (state->stats) {
+        stats_add(&state->stats->momentum_ticks, 1);
+    }
+    state->momentum_slot1.delta_ddx = state->momentum_vx * (progress - state->momentum_progress);
+    state->momentum_slot1.delta_ddy = state->momentum_vy * (progress - state->momentum_progress);
+    state->momentum_progress = progress;
+    do_scrolling(state, &state->momentum_slot1, &state->momentum_slot2, &time, TS_2_FINGER_SCROLL_MOMENTUM);
+    if (elapsed >= state->momentum_duration) {
+        transition(state, TS_DEFAULT, &time, "Scroll momentum is over");
+        return;
+    }
+    // wake up when the next MOMENTUM_STEP is due, less often as it slows down
+    speed = state->momentum_speed * pow(decay, elapsed / (MOMENTUM_TICK_MS * 1000.0));
+    millis = (int) (MOMENTUM_TICK_MS * MOMENTUM_STEP / speed);
+    if (millis < MOMENTUM_MIN_INTERVAL_MS) {
+        millis = MOMENTUM_MIN_INTERVAL_MS;
+    } else if (millis > MOMENTUM_MAX_INTERVAL_MS) {
+        millis = MOMENTUM_MAX_INTERVAL_MS;
+    }
+    // end exactly at the end of the glide, without a tiny last step
+    remaining = (state->momentum_duration - elapsed + 999) / 1000;
+    if (remaining - millis < MOMENTUM_MIN_INTERVAL_MS) {
+        millis = remaining;
+    }
+    set_timer(state, GESTURE_TIMER_SCROLL_MOMENTUM, millis);
+}
+/* Starts the glide with the velocity in momentum_slot1.delta_ddx/ddy (wheel
+ * clicks per MOMENTUM_TICK_MS). It lasts until the velocity of the faster
+ * axis decays below config.momentum_delta_limit. The glide keeps the decay
+ * it started with, even if the configuration changes meanwhile. */
+static void start_scroll_momentum(struct State *state, struct timeval *time) {
+    double limit = state->config.momentum_delta_limit;
+
+    state->momentum_vx = state->momentum_slot1.delta_ddx;
+    state->momentum_vy = state->momentum_slot1.delta_ddy;
+    state->momentum_speed = fmax(fabs(state->momentum_vx), fabs(state->momentum_vy));
+    state->momentum_start = *time;
+    state->momentum_progress = 0.0;
+    state->momentum_duration = 0;
+    state->momentum_decay = state->config.momentum_decay;
+    if (state->momentum_speed >= limit) {
+        state->momentum_duration = (floor(log(limit / state->momentum_speed) / log(state->momentum_decay)) + 1) * MOMENTUM_TICK_MS * 1000;
+    }
+    timerfunc_scroll_momentum(state);
+}
+/* Each action of the transition table gets the entry it was found in, so
+ * one action serves all rows that only differ in the state they go to. */
+static void stay(struct State *state, const struct Transition *t, struct timeval *time) {
+}
+static void go(struct State *state, const struct Transition *t, struct timeval *time) {
+    assert(t->next != BY_ACTION);
+    transition(state, t->next, time, t->msg);
+}
+static void tap(struct State *state, const struct Transition *t, struct timeval *time) {
+    int i = get_active_slot_id(state->prev_active);
+
+    if (i >= 0 && is_tap_click(state, &state->prev_slots[i])) {
+        post_button(state, MOUSE_LEFT_BUTTON, 1);
+        post_button(state, MOUSE_LEFT_BUTTON, 0);
+    }
+}
+static void go_and_tap(struct State *state, const struct Transition *t, struct timeval *time) {
+    go(state, t, time);
+    tap(state, t, time);
+}
+static void move_pointer(struct State *state, const struct Transition *t, struct timeval *time) {
+    int i = get_active_slot_id(state->active);
+    struct Slot *slot = &state->slots[i];
+
+    set_start_fields_if_not_set(slot, time);
+    calculate_dx_dy(state, slot, &state->prev_slots[i], time);
+    if (slot->dx != 0 || slot->dy != 0) {
+        post_motion(state, slot->dx, slot->dy);
+    }
+}
+/* Goes to 'next' once the fingers moved a wheel click. */
+static void scroll(struct State *state, const struct Transition *t, struct timeval *time) {
+    struct Slot *slot1, *slot2, *prev_slot1, *prev_slot2;
+
+    get_2_active_slots(state->slots, state->active, &slot1, &slot2);
+    get_2_active_slots(state->prev_slots, state->prev_active, &prev_slot1, &prev_slot2);
+    handle_2_finger_scroll(state, slot1, slot2, prev_slot1, prev_slot2, time, t->next);
+}
+/* Goes to 'next' and presses the button once the fingers moved. */
+static void drag(struct State *state, const struct Transition *t, struct timeval *time) {
+    struct Slot *slot1, *slot2, *slot3, *prev_slot1, *prev_slot2, *prev_slot3;
+
+    get_3_active_slots(state->slots, state->active, &slot1, &slot2, &slot3);
+    get_3_active_slots(state->prev_slots, state->prev_active, &prev_slot1, &prev_slot2, &prev_slot3);
+    handle_3_finger_drag(state, slot1, slot2, slot3, prev_slot1, prev_slot2, prev_slot3, time, t->next);
+}
+/* A finger of a 2 finger scroll was lifted, the scroll is releasing. If
+ * both were moving fast enough up to the frame before, it glides on. The velocity is
+ * the fitted one of the two fingers, in wheel clicks per MOMENTUM_TICK_MS
+ * and locked to one axis like the scroll. */
+static void lift_scroll(struct State *state, const struct Transition *t, struct timeval *time) {
+    struct Slot *prev_slot1, *prev_slot2;
+    double limit = 2 * state->config.momentum_delta_limit;
+    double scale = MOMENTUM_TICK_MS / 1000.0 / state->config.scroll_divisor / 2;
+    double vx, vy;
+
+    transition(state, TS_2_FINGER_SCROLL_RELEASING, time, NULL);
+    if (state->prev_active_slots != 2) {
+        return;
+    }
+    get_2_active_slots(state->prev_slots, state->prev_active, &prev_slot1, &prev_slot2);
+    vx = (prev_slot1->vx + prev_slot2->vx) * scale;
+    vy = (prev_slot1->vy + prev_slot2->vy) * scale;
+    if (fabs(vx) > state->config.scroll_axis_lock * fabs(vy)) {
+        vy = 0.0;
+    }
+    if (fabs(vy) > state->config.scroll_axis_lock * fabs(vx)) {
+        vx = 0.0;
+    }
+    if (fabs(vx) < limit && fabs(vy) < limit) {
+        return;
+    }
+    state->momentum_slot1 = *prev_slot1;
+    state->momentum_slot2 = *prev_slot2;
+    state->momentum_slot1.delta_ddx = fabs(vx) < limit ? 0.0 : vx;
+    state->momentum_slot1.delta_ddy = fabs(vy) < limit ? 0.0 : vy;
+    transition(state, TS_2_FINGER_SCROLL_MOMENTUM, time, NULL);
+}
+/* The finger left after a 2 finger scroll moves the pointer again once
+ * config.scroll_release msec passed, from where it is then. */
+static void wait_scroll_release(struct State *state, const struct Transition *t, struct timeval *time) {
+    struct Slot *slot = &state->slots[get_active_slot_id(state->active)];
+
+    if (usec_diff(time, &state->touchpad_state_updated_at) < state->config.scroll_release * 1000) {
+        return;
+    }
+    go(state, t, time);
+    slot->startx = slot->x;
+    slot->starty = slot->y;
+}
+/* One finger resting on the touchpad for a moment stops the glide. */
+static void touch_momentum(struct State *state, const struct Transition *t, struct timeval *time) {
+    struct Slot *slot = &state->slots[get_active_slot_id(state->active)];
+
+    if (slot->elapsed_useconds >= 50000 && usec_diff(time, &state->touchpad_state_updated_at) > 50000) {
+        go(state, t, time);
+    }
+}
+/* The 3 fingers did not come back in config.drag_release msec. */
+static void end_drag(struct State *state, const struct Transition *t, struct timeval *time) {
+    go(state, t, time);
+    post_button(state, MOUSE_LEFT_BUTTON, 0);
+}
+/* Pointer motion resumes config.scroll_release msec after a 2 finger scroll
+ * ended, even if the remaining finger does not move. */
+static void end_scroll_release(struct State *state, const struct Transition *t, struct timeval *time) {
+    struct Slot *slot;
+    int i;
+
+    if (state->active_slots > 1) {
+        return;
+    }
+    i = get_active_slot_id(state->active);
+    if (i >= 0) {
+        transition(state, t->next, time, "Switching to normal mouse moving");
+        // overwrite the start position
+        slot = &state->slots[i];
+        slot->startx = slot->x;
+        slot->starty = slot->y;
+    } else {
+        transition(state, t->next, time, "No more fingers touching");
+    }
+}
+/* The glide scrolls on, and goes to TS_DEFAULT once it is over. */
+static void momentum_tick(struct State *state, const struct Transition *t, struct timeval *time) {
+    timerfunc_scroll_momentum(state);
+}
+
+// the rows of the table that do the same in every state
+#define STAY(s) { stay, s, NULL }
+#define ON_TIMERS_STAY(s) \
+    [GESTURE_INPUT_TIMER + GESTURE_TIMER_DRAG_RELEASE] = STAY(s), \
+    [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_MOMENTUM] = STAY(s), \
+    [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_RELEASE] = STAY(s)
+
+/* What every input does in every state. The action runs in the state of
+ * the row; 'next' is where it goes, if it does (some only go there after
+ * enough motion or time), or BY_ACTION where the action picks one of
+ * several. Every pair has an entry, see transitions_complete(), so no
+ * finger combination leaves a state behind. */
+static const struct Transition transitions[TS_NUM_STATES][GESTURE_NUM_INPUTS] = {
+    [TS_DEFAULT] = {
+        [GESTURE_INPUT_LIFTED] = { tap, TS_DEFAULT, NULL },
+        [GESTURE_INPUT_NONE] = STAY(TS_DEFAULT),
+        [GESTURE_INPUT_ONE] = { move_pointer, TS_DEFAULT, NULL },
+        [GESTURE_INPUT_TWO] = { scroll, TS_2_FINGER_SCROLL, NULL },
+        [GESTURE_INPUT_TWO_CHANGED] = STAY(TS_DEFAULT),
+        [GESTURE_INPUT_THREE] = { drag, TS_3_FINGER_DRAG, NULL },
+        [GESTURE_INPUT_THREE_CHANGED] = STAY(TS_DEFAULT),
+        [GESTURE_INPUT_MANY] = STAY(TS_DEFAULT),
+        ON_TIMERS_STAY(TS_DEFAULT),
+    },
+    [TS_2_FINGER_SCROLL] = {
+        [GESTURE_INPUT_LIFTED] = { lift_scroll, BY_ACTION, NULL },
+        [GESTURE_INPUT_NONE] = { lift_scroll, BY_ACTION, NULL },
+        [GESTURE_INPUT_ONE] = { lift_scroll, BY_ACTION, NULL },
+        [GESTURE_INPUT_TWO] = { scroll, TS_2_FINGER_SCROLL, NULL },
+        // the fingers were swapped within one frame, the next one scrolls on
+        [GESTURE_INPUT_TWO_CHANGED] = STAY(TS_2_FINGER_SCROLL),
+        [GESTURE_INPUT_THREE] = { go, TS_DEFAULT, "Cancel 2 finger scroll because more than 2 fingers touched" },
+        [GESTURE_INPUT_THREE_CHANGED] = { go, TS_DEFAULT, "Cancel 2 finger scroll because more than 2 fingers touched" },
+        [GESTURE_INPUT_MANY] = { go, TS_DEFAULT, "Cancel 2 finger scroll because more than 2 fingers touched" },
+        ON_TIMERS_STAY(TS_2_FINGER_SCROLL),
+    },
+    [TS_2_FINGER_SCROLL_RELEASING] = {
+        [GESTURE_INPUT_LIFTED] = { go_and_tap, TS_DEFAULT, "No more fingers touching" },
+        [GESTURE_INPUT_NONE] = { go, TS_DEFAULT, "No more fingers touching" },
+        [GESTURE_INPUT_ONE] = { wait_scroll_release, TS_DEFAULT, "Switching to normal mouse moving" },
+        [GESTURE_INPUT_TWO] = { scroll, TS_2_FINGER_SCROLL, NULL },
+        // the second finger came back, scroll on from the next frame
+        [GESTURE_INPUT_TWO_CHANGED] = STAY(TS_2_FINGER_SCROLL_RELEASING),
+        [GESTURE_INPUT_THREE] = { drag, TS_3_FINGER_DRAG, NULL },
+        [GESTURE_INPUT_THREE_CHANGED] = { go, TS_DEFAULT, "Cancel 2 finger scroll release because more fingers touched" },
+        [GESTURE_INPUT_MANY] = { go, TS_DEFAULT, "Cancel 2 finger scroll release because more fingers touched" },
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_DRAG_RELEASE] = STAY(TS_2_FINGER_SCROLL_RELEASING),
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_MOMENTUM] = STAY(TS_2_FINGER_SCROLL_RELEASING),
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_RELEASE] = { end_scroll_release, TS_DEFAULT, NULL },
+    },
+    [TS_2_FINGER_SCROLL_MOMENTUM] = {
+        [GESTURE_INPUT_LIFTED] = STAY(TS_2_FINGER_SCROLL_MOMENTUM),
+        [GESTURE_INPUT_NONE] = STAY(TS_2_FINGER_SCROLL_MOMENTUM),
+        [GESTURE_INPUT_ONE] = { touch_momentum, TS_DEFAULT, "Cancel scroll momentum with 1 finger" },
+        [GESTURE_INPUT_TWO] = { go, TS_DEFAULT, "Cancel 2 finger scroll momentum with 2 or more fingers" },
+        [GESTURE_INPUT_TWO_CHANGED] = { go, TS_DEFAULT, "Cancel 2 finger scroll momentum with 2 or more fingers" },
+        [GESTURE_INPUT_THREE] = { go, TS_DEFAULT, "Cancel 2 finger scroll momentum with 2 or more fingers" },
+        [GESTURE_INPUT_THREE_CHANGED] = { go, TS_DEFAULT, "Cancel 2 finger scroll momentum with 2 or more fingers" },
+        [GESTURE_INPUT_MANY] = { go, TS_DEFAULT, "Cancel 2 finger scroll momentum with 2 or more fingers" },
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_DRAG_RELEASE] = STAY(TS_2_FINGER_SCROLL_MOMENTUM),
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_MOMENTUM] = { momentum_tick, BY_ACTION, NULL },
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_RELEASE] = STAY(TS_2_FINGER_SCROLL_MOMENTUM),
+    },
+    [TS_3_FINGER_DRAG] = {
+        [GESTURE_INPUT_LIFTED] = { go, TS_3_FINGER_DRAG_RELEASING, NULL },
+        [GESTURE_INPUT_NONE] = { go, TS_3_FINGER_DRAG_RELEASING, NULL },
+        [GESTURE_INPUT_ONE] = { go, TS_3_FINGER_DRAG_RELEASING, NULL },
+        [GESTURE_INPUT_TWO] = { go, TS_3_FINGER_DRAG_RELEASING, NULL },
+        [GESTURE_INPUT_TWO_CHANGED] = { go, TS_3_FINGER_DRAG_RELEASING, NULL },
+        [GESTURE_INPUT_THREE] = { drag, TS_3_FINGER_DRAG, NULL },
+        // a finger was replaced within one frame, the next one drags on
+        [GESTURE_INPUT_THREE_CHANGED] = STAY(TS_3_FINGER_DRAG),
+        [GESTURE_INPUT_MANY] = { go, TS_3_FINGER_DRAG_RELEASING, NULL },
+        ON_TIMERS_STAY(TS_3_FINGER_DRAG),
+    },
+    [TS_3_FINGER_DRAG_RELEASING] = {
+        // wait for the timer to end the drag or the user to put 3 fingers back
+        [GESTURE_INPUT_LIFTED] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_NONE] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_ONE] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_TWO] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_TWO_CHANGED] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_THREE] = { go, TS_3_FINGER_DRAG, NULL },
+        [GESTURE_INPUT_THREE_CHANGED] = { go, TS_3_FINGER_DRAG, NULL },
+        [GESTURE_INPUT_MANY] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_DRAG_RELEASE] = { end_drag, TS_DEFAULT, "Cancel 3 finger drag" },
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_MOMENTUM] = STAY(TS_3_FINGER_DRAG_RELEASING),
+        [GESTURE_INPUT_TIMER + GESTURE_TIMER_SCROLL_RELEASE] = STAY(TS_3_FINGER_DRAG_RELEASING),
+    },
+};
+
+/* The input of a frame by the number of active slots in it and in the frame
+ * before, 4 standing for 4 and more. */
+static const unsigned char frame_inputs[5][5] = {
+    { GESTURE_INPUT_NONE, GESTURE_INPUT_LIFTED, GESTURE_INPUT_NONE, GESTURE_INPUT_NONE, GESTURE_INPUT_NONE },
+    { GESTURE_INPUT_ONE, GESTURE_INPUT_ONE, GESTURE_INPUT_ONE, GESTURE_INPUT_ONE, GESTURE_INPUT_ONE },
+    { GESTURE_INPUT_TWO_CHANGED, GESTURE_INPUT_TWO_CHANGED, GESTURE_INPUT_TWO, GESTURE_INPUT_TWO_CHANGED, GESTURE_INPUT_TWO_CHANGED },
+    { GESTURE_INPUT_THREE_CHANGED, GESTURE_INPUT_THREE_CHANGED, GESTURE_INPUT_THREE_CHANGED, GESTURE_INPUT_THREE, GESTURE_INPUT_THREE_CHANGED },
+    { GESTURE_INPUT_MANY, GESTURE_INPUT_MANY, GESTURE_INPUT_MANY, GESTURE_INPUT_MANY, GESTURE_INPUT_MANY },
+};
+
+static void dispatch(struct State *state, enum GestureInput input, struct timeval *time) {
+    const struct Transition *t = &transitions[state->touchpad_state][input];
+
+    t->action(state, t, time);
+}
+#ifndef NDEBUG
+/* Every state must say what every input does, staying put included. */
+static int transitions_complete(void) {
+    int s, i;
+
+    for (s = 0; s < TS_NUM_STATES; ++s) {
+        for (i = 0; i < GESTURE_NUM_INPUTS; ++i) {
+            if (!transitions[s][i].action || transitions[s][i].next < 0 || transitions[s][i].next > BY_ACTION) {
+                fprintf(stderr, "gesture: no transition for %s on input %d\n", touchpad_state_name(s), i);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+#endif
+void process_EV_SYN(struct State *state, struct timeval *time) {
+    int now = state->active_slots < 4 ? state->active_slots : 4;
+    int before = state->prev_active_slots < 4 ? state->prev_active_slots : 4;
+
+    dispatch(state, frame_inputs[now][before], time);
+}
+
+void save_current_values_to_prev(struct State *state) {
+    int i, slot_id;
+    struct Slot *slots = state->slots;
+    struct SlotShape *shapes = state->shapes;
+    struct SlotIndex *active = state->active;
+    state->prev_active_slots = state->active_slots;
+    // the frame just processed becomes the previous one, and the frame before
+    // it is reused as the current one
+    state->frame = (state->frame + 1) % NUM_FRAMES;
+    set_frame_pointers(state);
+    // the reused frame differs only in the slots written during the last frame:
+    // the ones events arrived for plus the active ones process_EV_SYN updated
+    for (i = 0; i < active->count; ++i) {
+        add_to_slot_index(&state->dirty, active->ids[i]);
+    }
+    for (i = 0; i < state->dirty.count; ++i) {
+        slot_id = state->dirty.ids[i];
+        state->slots[slot_id] = slots[slot_id];
+        state->shapes[slot_id] = shapes[slot_id];
+    }
+    copy_slot_index(state->active, active);
+    clear_slot_index(&state->dirty);
+}
+void process_event(struct State *state, struct timeval *time, int type, int code, int value) {
+    state->trace.now = time->tv_sec * 1000000ULL + time->tv_usec;
+    trace_record(&state->trace, TRACE_LEVEL_EVENTS, TRACE_EVENT, 0, type, code, value, 0);
+    // the kernel gives all events of a frame the same time; while coalescing
+    // the output waits for the oldest frame
+    if (state->frame_events++ == 0 && state->stats && (!state->coalescing || !timerisset(&state->input_time))) {
+        state->input_time = *time;
+    }
+    switch (type) {
+        case EV_SYN:
+        if (state->stats) {
+            stats_add(&state->stats->frames, 1);
+            stats_add(&state->stats->events, state->frame_events);
+            stats_record(&state->stats->events_per_frame, state->frame_events);
+            stats_update_time(state, time);
+        }
+        state->frame_events = 0;
+        calculate_elapsed_useconds_and_active_slots(state, time);
+        filter_slots(state);
+        estimate_velocities(state);
+        trace_frame(state);
+        process_EV_SYN(state, time);
+        save_current_values_to_prev(state);
+        break;
+        case EV_KEY:
+        switch (code) {
+            case BTN_LEFT:
+            // the release goes to the button of the press, the fingers on
+            // the touchpad may have changed in between
+            if (value) {
+                state->click_button = state->active_slots == 1 ? MOUSE_LEFT_BUTTON :
+                                      state->active_slots == 2 ? MOUSE_RIGHT_BUTTON : 0;
+                if (state->click_button) {
+                    post_button(state, state->click_button, 1);
+                }
+            } else if (state->click_button) {
+                post_button(state, state->click_button, 0);
+                state->click_button = 0;
+            }
+            break;
+            case BTN_TOOL_FINGER:
+            break;
+            case BTN_TOOL_QUINTTAP:
+            break;
+            case BTN_TOUCH:
+            break;
+            case BTN_TOOL_DOUBLETAP:
+            break;
+            case BTN_TOOL_TRIPLETAP:
+            break;
+            case BTN_TOOL_QUADTAP:
+            break;
+        }
+        break;
+        case EV_ABS:
+        if (state->current_slot_id < 0 && code != ABS_MT_SLOT) {
+            // the last ABS_MT_SLOT was out of range, drop its values
+            break;
+        }
+        if (state->current_slot_id >= 0) {
+            add_to_slot_index(&state->dirty, state->current_slot_id);
+        }
+        switch (code) {
+            case ABS_X:
+            break;
+            case ABS_Y:
+            break;
+            case ABS_PRESSURE:
+            state->slots[state->current_slot_id].pressure = value;
+            break;
+            case ABS_TOOL_WIDTH:
+            break;
+            case ABS_MT_SLOT:
+            if (state->current_slot_id >= 0) {
+                set_start_fields_if_not_set(&state->slots[state->current_slot_id], time);
+            }
+            if (value < 0 || value >= state->num_slots) {
+                trace_record(&state->trace, TRACE_LEVEL_STATE, TRACE_SLOT_RANGE, 0, value, state->num_slots, 0, 0);
+                state->current_slot_id = -1;
+                break;
+            }
+            state->current_slot_id = value;
+            activate_current_slot(state, time);
+            break;
+            case ABS_MT_TOUCH_MAJOR:
+            state->shapes[state->current_slot_id].touch_major = value;
+            break;
+            case ABS_MT_TOUCH_MINOR:
+            state->shapes[state->current_slot_id].touch_minor = value;
+            break;
+            case ABS_MT_WIDTH_MAJOR:
+            state->shapes[state->current_slot_id].width_major = value;
+            break;
+            case ABS_MT_WIDTH_MINOR:
+            state->shapes[state->current_slot_id].width_minor = value;
+            break;
+            case ABS_MT_ORIENTATION:
+            state->shapes[state->current_slot_id].orientation = value;
+            break;
+            case ABS_MT_POSITION_X:
+            state->slots[state->current_slot_id].x = value;
+            break;
+            case ABS_MT_POSITION_Y:
+            state->slots[state->current_slot_id].y = value;
+            break;
+            case ABS_MT_TRACKING_ID:
+            if (value < 0) {
+                deactivate_current_slot(state);
+            } else {
+                activate_current_slot(state, time);
+            }
+            break;
+        }
+        break;
+    }
+}
+/* Feeds a batch of events straight from a read() buffer, normally one frame
+ * up to and including its SYN_REPORT. */
+void process_frame(struct State *state, struct input_event *events, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        process_event(state, &events[i].time, events[i].type, events[i].code, events[i].value);
+    }
+}
+/* Between these two calls motion and scroll are merged instead of posted
+ * frame by frame; the driver brackets every read with them, so a backlog of
+ * frames after a stall moves the pointer in one step. The frames still
+ * update the slots as usual, and buttons keep their place in the output. */
+void gesture_coalesce_begin(struct State *state) {
+    state->coalescing = 1;
+}
+void gesture_coalesce_end(struct State *state) {
+    flush_motion(state);
+    flush_scroll(state);
+    state->coalescing = 0;
+    timerclear(&state->input_time);
+}
+/* Whether process_event() does anything with this event, given the
+ * enabled features. The driver has the kernel drop all other events. */
+int gesture_wants_event(struct State *state, int type, int code) {
+    switch (type) {
+        case EV_SYN:
+        return 1;
+        case EV_KEY:
+        return code == BTN_LEFT;
+        case EV_ABS:
+        switch (code) {
+            case ABS_PRESSURE:
+            case ABS_MT_SLOT:
+            case ABS_MT_POSITION_X:
+            case ABS_MT_POSITION_Y:
+            case ABS_MT_TRACKING_ID:
+            return 1;
+            case ABS_MT_TOUCH_MAJOR:
+            case ABS_MT_TOUCH_MINOR:
+            case ABS_MT_WIDTH_MAJOR:
+            case ABS_MT_WIDTH_MINOR:
+            case ABS_MT_ORIENTATION:
+            return (state->features & GESTURE_FEATURE_CONTACT_SHAPE) != 0;
+        }
+        return 0;
+    }
+    return 0;
+}
+/* Ends the gesture in progress, releases the buttons it holds and rebuilds
+ * both frames from 'touches', so the next frame carries on from there
+ * without a jump. current_slot_id is the device's ABS_MT_SLOT value. */
+static void restart(struct State *state, struct timeval *time, const struct GestureTouch *touches, int count, int current_slot_id, const char *msg) {
+    struct Slot *slot;
+    int i;
+
+    state->trace.now = time->tv_sec * 1000000ULL + time->tv_usec;
+    state->clock.cancel_timer(state->clock.data);
+    release_buttons(state);
+    state->click_button = 0;
+    // ends the dwell time of the state for the stats
+    update_touchpad_state_msg(state, TS_DEFAULT, time, msg);
+    clear_state(state);
+    state->frame_events = 0;
+    state->touchpad_state_updated_at = *time;
+
+    for (i = 0; i < count; ++i) {
+        if (touches[i].slot_id < 0 || touches[i].slot_id >= state->num_slots) {
+            continue;
+        }
+        state->current_slot_id = touches[i].slot_id;
+        slot = &state->slots[state->current_slot_id];
+        // the touch began before the drop: not new to the heuristics for a
+        // landing finger, and lifting it is no tap whatever the TapTime
+        slot->start_time.tv_sec = time->tv_sec - 1;
+        slot->start_time.tv_usec = time->tv_usec;
+        activate_current_slot(state, time);
+        slot->elapsed_useconds = usec_diff(time, &slot->start_time);
+        slot->no_tap = 1;
+        slot->x = touches[i].x;
+        slot->y = touches[i].y;
+        slot->pressure = touches[i].pressure;
+        filter_position(&slot->filter, slot->x, slot->y, 0.0, 0.0, 0.0, 0);
+        slot->fx = slot->x;
+        slot->fy = slot->y;
+        state->prev_slots[state->current_slot_id] = *slot;
+    }
+    copy_slot_index(state->prev_active, state->active);
+    state->active_slots = state->active->count;
+    state->prev_active_slots = state->active->count;
+    state->current_slot_id = current_slot_id >= 0 && current_slot_id < state->num_slots ? current_slot_id : -1;
+}
+/* The kernel dropped events, so the slot table no longer matches the
+ * fingers on the touchpad. 'touches' are the touches the device reports
+ * now. */
+void gesture_resync(struct State *state, struct timeval *time, const struct GestureTouch *touches, int count, int current_slot_id) {
+    state->resyncs++;
+    if (state->stats) {
+        stats_add(&state->stats->syn_dropped, 1);
+    }
+    state->trace.now = time->tv_sec * 1000000ULL + time->tv_usec;
+    trace_record(&state->trace, TRACE_LEVEL_STATE, TRACE_RESYNC, 0, count, state->resyncs, 0, 0);
+    restart(state, time, touches, count, current_slot_id, "Resync");
+}
+/* The device is switched off, for a VT switch or a suspend. Releases the
+ * buttons and stops the timeouts, a drag or a scroll glide must not go on
+ * when it comes back. */
+void gesture_suspend(struct State *state, struct timeval *time) {
+    restart(state, time, NULL, 0, -1, "Suspend");
+}
+/* The device is switched on again and 'touches' are on the touchpad, they
+ * carry on without a jump but do not tap when lifted. */
+void gesture_resume(struct State *state, struct timeval *time, const struct GestureTouch *touches, int count, int current_slot_id) {
+    restart(state, time, touches, count, current_slot_id, "Resume");
+}
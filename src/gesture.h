@@ -0,0 +1,350 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The gesture engine: turns evdev multitouch events into pointer motion,
+ * button and scroll output. It does not depend on the X server, all output
+ * goes through a GestureSink and all timing through a GestureClock, so the
+ * same code runs inside random_drv.so and in the command line tools.
+ */
+
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "accel.h"
+#include "filter.h"
+#include "stats.h"
+#include "trace.h"
+
+#define MOUSE_LEFT_BUTTON               1
+#define MOUSE_RIGHT_BUTTON              3
+#define MOUSE_MIDDLE_BUTTON             2
+#define MOUSE_VERTICAL_WHEEL_1_BUTTON   4
+#define MOUSE_VERTICAL_WHEEL_2_BUTTON   5
+#define MOUSE_HORIZONTAL_WHEEL_1_BUTTON 6
+#define MOUSE_HORIZONTAL_WHEEL_2_BUTTON 7
+
+// the defaults of struct GestureConfig
+#define TAP_TIME_MS 150
+#define TAP_MOVE 2
+#define SCROLL_DIVISOR 200.0
+#define SCROLL_AXIS_LOCK 4.0
+#define DRAG_RELEASE_MS 500
+// scroll momentum: the velocity in wheel clicks per MOMENTUM_TICK_MS
+// decays by MOMENTUM_DECAY every MOMENTUM_TICK_MS, the glide ends when it is
+// below MOMENTUM_DELTA_LIMIT
+#define MOMENTUM_DELTA_LIMIT 0.2f
+#define MOMENTUM_DECAY 0.97
+#define MOMENTUM_TICK_MS 10
+// the glide is computed from the elapsed time, the timer only decides how
+// often it is posted: at most once per 60 Hz frame, less often when slow
+#define MOMENTUM_MIN_INTERVAL_MS 16
+#define MOMENTUM_MAX_INTERVAL_MS 100
+#define MOMENTUM_STEP 0.5 // wheel clicks per timer tick once the glide is slow
+#define MOMENTUM_MIN_SCROLL 0.01 // wheel clicks, less than a pixel
+
+// pointer motion is ignored this long after a 2 finger scroll ended, default
+#define SCROLL_RELEASE_MS 100
+
+// the jitter filter of the pointer motion, see filter.h: the cutoff of a
+// slow finger in Hz, how much it rises per touchpad unit per second of
+// speed, and the deadzone of a resting finger in touchpad units
+#define FILTER_MIN_CUTOFF 5.0
+#define FILTER_BETA 0.01
+#define FILTER_HYSTERESIS 25
+
+// msec of finger positions the velocity is fitted over, default
+#define VELOCITY_WINDOW_MS 40
+// positions kept per slot for that, a power of two; a window longer than
+// they cover uses all of them
+#define HISTORY_SIZE 16
+
+#define NUM_FRAMES 2
+
+/* Optional parts of the engine, bits of state->features. The driver
+ * narrows the kernel's event mask to what the enabled ones need, see
+ * gesture_wants_event(). */
+enum GestureFeatures {
+    GESTURE_FEATURE_CONTACT_SHAPE = 1 << 0, // store touch/width major/minor and orientation
+};
+
+enum TouchpadStates {
+    TS_DEFAULT,
+    TS_2_FINGER_SCROLL, // there are 2 active slots
+    TS_2_FINGER_SCROLL_RELEASING, // previously there were 2 active slots but now only 1. Ignoring pointer movements for a short period to avoid accidental pointer movements after scrolling with 2 fingers
+    TS_2_FINGER_SCROLL_MOMENTUM,
+    TS_3_FINGER_DRAG,
+    TS_3_FINGER_DRAG_RELEASING,
+    TS_NUM_STATES,
+};
+
+/* Receives everything the engine wants to post. scroll() gets the scroll
+ * distance of one frame in wheel clicks, with fractions. Positive dx and dy
+ * follow the fingers moving right and down, which is wheel button 6 and 4. */
+struct GestureSink {
+    void (*motion)(void *data, int dx, int dy);
+    void (*button)(void *data, int button, int is_press);
+    void (*scroll)(void *data, double dx, double dy);
+    void *data;
+};
+
+/* Time source of the engine. now() must use the same clock as the event
+ * timestamps. The engine keeps its own deadlines and multiplexes them onto
+ * the one timer of the clock, always armed for the earliest: set_timer()
+ * replaces the pending timeout, and when it expires the owner calls
+ * gesture_timer_expired(). */
+struct GestureClock {
+    void (*now)(void *data, struct timeval *time);
+    void (*set_timer)(void *data, int millis);
+    void (*cancel_timer)(void *data);
+    void *data;
+};
+
+/* The thresholds of the gestures, see gesture_set_config(). Only the
+ * momentum of a scroll faster than twice momentum_delta_limit keeps going
+ * after the fingers left. */
+struct GestureConfig {
+    int tap_time; // msec, a longer touch is not a tap
+    int tap_move; // pixels of pointer motion a tap may move on each axis, see total_dx
+    double scroll_divisor; // touchpad units per wheel click
+    double scroll_axis_lock; // the slower axis does not scroll if the other is this many times faster
+    double momentum_decay; // per MOMENTUM_TICK_MS
+    double momentum_delta_limit; // wheel clicks per MOMENTUM_TICK_MS
+    int drag_release; // msec the 3 finger drag waits for the fingers to come back
+    int scroll_release; // msec pointer motion is ignored after a 2 finger scroll
+    double filter_min_cutoff; // Hz, 0 turns the smoothing of the pointer motion off
+    double filter_beta;
+    int filter_hysteresis; // touchpad units, 0 turns the deadzone off
+    int velocity_window; // msec, 0 takes the velocity from the last frame alone
+};
+
+/* A touch as the device reports it after the kernel dropped events, see
+ * gesture_resync() and gesture_resume(). */
+struct GestureTouch {
+    int slot_id;
+    int x;
+    int y;
+    int pressure; // ABS_PRESSURE of the device, what process_event() follows
+};
+
+/* The timeouts of the engine, each can be pending once. */
+enum GestureTimer {
+    GESTURE_TIMER_DRAG_RELEASE, // 3 finger drag ends unless a finger comes back
+    GESTURE_TIMER_SCROLL_MOMENTUM, // next step of the glide
+    GESTURE_TIMER_SCROLL_RELEASE, // pointer motion resumes after a 2 finger scroll
+    GESTURE_NUM_TIMERS,
+};
+
+/* What the gesture state machine reacts to: a frame, by how many fingers
+ * it has and whether that changed, or a timeout. */
+enum GestureInput {
+    GESTURE_INPUT_LIFTED, // no finger, after one: the end of a tap
+    GESTURE_INPUT_NONE, // no finger otherwise
+    GESTURE_INPUT_ONE,
+    GESTURE_INPUT_TWO, // 2 fingers, 2 in the frame before as well
+    GESTURE_INPUT_TWO_CHANGED,
+    GESTURE_INPUT_THREE, // 3 fingers, 3 in the frame before as well
+    GESTURE_INPUT_THREE_CHANGED,
+    GESTURE_INPUT_MANY, // 4 or more fingers
+    GESTURE_INPUT_TIMER, // plus the enum GestureTimer that expired
+    GESTURE_NUM_INPUTS = GESTURE_INPUT_TIMER + GESTURE_NUM_TIMERS,
+};
+
+struct GestureDeadline {
+    struct timeval at;
+    enum GestureTimer timer;
+};
+
+struct State;
+struct input_event;
+
+/* The fields the per-frame code reads and writes. The contact shape, which
+ * is only stored, lives in struct SlotShape so it does not share cache
+ * lines with these. */
+struct Slot {
+    int active;
+    int x;
+    int y;
+    int pressure;
+
+    struct timeval start_time;
+    int elapsed_useconds;
+    int no_tap; // carried over a resync or resume, lifting it is no tap
+
+    int startx;
+    int starty;
+
+    double ddx;
+    double ddy;
+    double delta_ddx;
+    double delta_ddy;
+    int dx;
+    int dy;
+    // pixels the raw position moved since the slot is active, for the taps,
+    // and their sub-pixel rest; the jitter filter does not apply to them
+    int total_dx;
+    int total_dy;
+    double tap_ddx;
+    double tap_ddy;
+
+    // x and y after filter_slots(), what the pointer motion is computed from
+    int fx;
+    int fy;
+    struct PositionFilter filter;
+    // touchpad units per second, see estimate_velocities()
+    double vx;
+    double vy;
+};
+struct SlotShape {
+    int touch_major;
+    int touch_minor;
+    int width_major;
+    int width_minor;
+    int orientation;
+};
+/* The last positions of a finger, for its velocity. Unlike the slots it is
+ * not part of a frame, estimate_velocities() adds one entry per frame. */
+struct SlotHistory {
+    int count; // at most HISTORY_SIZE
+    int head; // where the next position goes
+    int t[HISTORY_SIZE]; // elapsed_useconds of the slot
+    int x[HISTORY_SIZE];
+    int y[HISTORY_SIZE];
+};
+/* Which slots are active, kept up to date as the slot events arrive so the
+ * per-frame code never has to scan all slots. 'ids' holds the active slot
+ * ids in ascending order, 'mask' has the same set as bits. */
+struct SlotIndex {
+    uint32_t *mask;
+    int *ids;
+    int count;
+};
+/* All slots as of one EV_SYN. */
+struct Frame {
+    struct Slot *slots;
+    struct SlotShape *shapes;
+    struct SlotIndex active;
+};
+/* The slot storage is sized for the device (num_slots, from the
+ * ABS_MT_SLOT range) and allocated by gesture_init() in one cache line
+ * aligned block. The current and the previous frame live in 'frames' and
+ * swap roles at every EV_SYN. 'slots'/'active' point into the current one and
+ * 'prev_slots'/'prev_active' into the previous one. 'dirty' collects the
+ * slots written since the last swap, those are the only ones that have to
+ * be carried over into the recycled frame. */
+struct State {
+    void *storage;
+    int num_slots;
+    struct Frame frames[NUM_FRAMES];
+    int frame;
+    struct Slot *slots;
+    struct Slot *prev_slots;
+    struct SlotShape *shapes;
+    struct SlotIndex *active;
+    struct SlotIndex *prev_active;
+    struct SlotIndex dirty;
+    struct SlotHistory *history; // one per slot
+    int current_slot_id;
+    int active_slots;
+    int prev_active_slots;
+    enum TouchpadStates touchpad_state;
+    struct timeval touchpad_state_updated_at;
+    // pending timeouts, a min-heap on 'at', see set_timer()
+    struct GestureDeadline deadlines[GESTURE_NUM_TIMERS];
+    int num_deadlines;
+    int deadline_pos[GESTURE_NUM_TIMERS]; // index into deadlines or -1
+    unsigned int features; // enum GestureFeatures
+    unsigned int buttons; // bit n is set while button n is pressed
+    int click_button; // what the physical button pressed, 0 while it is up
+    unsigned long resyncs; // how often the kernel dropped events
+    struct GestureStats *stats; // NULL unless gesture_set_stats() was called
+    int frame_events; // events of the frame so far
+    struct timeval input_time; // of the oldest frame whose output is not posted yet, for stats
+    struct Trace trace; // see trace.h, off until trace_set_level()
+    // output merged between gesture_coalesce_begin() and _end()
+    int coalescing;
+    int pending_dx;
+    int pending_dy;
+    double pending_scroll_dx;
+    double pending_scroll_dy;
+    struct Slot momentum_slot1;
+    struct Slot momentum_slot2;
+    struct timeval momentum_start;
+    double momentum_vx; // starting velocity
+    double momentum_vy;
+    double momentum_speed; // of the faster axis
+    double momentum_progress; // posted so far, see momentum_progress()
+    long momentum_duration; // usec
+    double momentum_decay; // config.momentum_decay when the glide started
+    struct AccelCurve accel; // see gesture_set_accel_profile()
+    struct GestureConfig config;
+    struct GestureSink sink;
+    struct GestureClock clock;
+};
+
+int gesture_init(struct State *state, int num_slots, const struct GestureSink *sink, const struct GestureClock *clock);
+void gesture_free(struct State *state);
+void gesture_timer_expired(struct State *state);
+void gesture_set_accel_profile(struct State *state, enum AccelProfile profile);
+void gesture_set_stats(struct State *state, struct GestureStats *stats);
+void gesture_default_config(struct GestureConfig *config);
+int gesture_check_config(const struct GestureConfig *config);
+int gesture_set_config(struct State *state, const struct GestureConfig *config);
+void gesture_coalesce_begin(struct State *state);
+void gesture_coalesce_end(struct State *state);
+int gesture_wants_event(struct State *state, int type, int code);
+void gesture_resync(struct State *state, struct timeval *time, const struct GestureTouch *touches, int count, int current_slot_id);
+void gesture_suspend(struct State *state, struct timeval *time);
+void gesture_resume(struct State *state, struct timeval *time, const struct GestureTouch *touches, int count, int current_slot_id);
+
+const char *type_and_code_name(int type, int code);
+const char *touchpad_state_name(enum TouchpadStates state);
+time_t usec_diff(struct timeval *end, struct timeval *start);
+void calculate_elapsed_useconds_and_active_slots(struct State *state, struct timeval *time);
+void filter_slots(struct State *state);
+void estimate_velocities(struct State *state);
+void clear_state(struct State *state);
+void clear_slot(struct Slot *slot);
+void clear_slot_shape(struct SlotShape *shape);
+void clear_slot_index(struct SlotIndex *index);
+void add_to_slot_index(struct SlotIndex *index, int slot_id);
+void remove_from_slot_index(struct SlotIndex *index, int slot_id);
+void copy_slot_index(struct SlotIndex *dst, const struct SlotIndex *src);
+void activate_current_slot(struct State *state, struct timeval *time);
+void deactivate_current_slot(struct State *state);
+int get_active_slot_id(struct SlotIndex *index);
+void get_2_active_slots(struct Slot slots[], struct SlotIndex *index, struct Slot **slot1, struct Slot **slot2);
+void get_3_active_slots(struct Slot slots[], struct SlotIndex *index, struct Slot **slot1, struct Slot **slot2, struct Slot **slot3);
+int is_tap_click(struct State *state, struct Slot *slot);
+void set_start_fields_if_not_set(struct Slot *slot, struct timeval *time);
+void calculate_dx_dy(struct State *state, struct Slot *slot, struct Slot *prev_slot, struct timeval *time);
+void update_touchpad_state(struct State *state, enum TouchpadStates new_state, struct timeval *time);
+void update_touchpad_state_msg(struct State *state, enum TouchpadStates new_state, struct timeval *time, const char *msg);
+void do_scrolling(struct State *state, struct Slot *slot1, struct Slot *slot2, struct timeval *time, enum TouchpadStates next);
+void handle_2_finger_scroll(struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *prev_slot1, struct Slot *prev_slot2, struct timeval *time, enum TouchpadStates next);
+void handle_3_finger_drag(struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *slot3, struct Slot *prev_slot1, struct Slot *prev_slot2, struct Slot *prev_slot3, struct timeval *time, enum TouchpadStates next);
+void process_EV_SYN(struct State *state, struct timeval *time);
+void save_current_values_to_prev(struct State *state);
+void process_event(struct State *state, struct timeval *time, int type, int code, int value);
+void process_frame(struct State *state, struct input_event *events, int count);
+
+#endif /* GESTURE_H */
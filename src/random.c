@@ -51,19 +51,48 @@
 
 #endif
 
+/* XI 2.1 scroll valuators, server 1.12 and later */
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 14
+#define HAVE_SMOOTH_SCROLLING
+#endif
+
+/* XI device properties, server 1.6 and later */
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 3
+#define HAVE_DEVICE_PROPERTIES
+#include <xserver-properties.h>
+#endif
+
+/* read_input runs on the input thread, server 1.19 and later */
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 24
+#define HAVE_INPUT_THREAD
+#endif
 
+
+#include <stddef.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_INPUT_THREAD
+#include <sys/eventfd.h>
+#endif
+#include <time.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
 #include <xorg-server.h>
 #include <xorgVersion.h>
 #include <xf86Module.h>
 #include <X11/Xatom.h>
 
+#include "gesture.h"
+#include "recorder.h"
+#include "safefile.h"
 #include "random.h"
 
 
@@ -71,6 +100,39 @@
  * "initialization discards 'const' qualifier from pointer target type" */
 static char random_driver_name[] = "random";
 
+/* The gesture thresholds, each is an Option and a device property of the
+ * same value. The float ones are 32 bit FLOAT properties, the others 32 bit
+ * INTEGER. */
+static const struct {
+    const char *option;
+    const char *property;
+    Bool is_float;
+    size_t offset; /* into struct GestureConfig */
+} random_tunables[RANDOM_TUNABLES] = {
+    { "TapTime",           "Random Tap Time",           FALSE, offsetof(struct GestureConfig, tap_time) },
+    { "TapMove",           "Random Tap Move",           FALSE, offsetof(struct GestureConfig, tap_move) },
+    { "ScrollDivisor",     "Random Scroll Divisor",     TRUE,  offsetof(struct GestureConfig, scroll_divisor) },
+    { "ScrollAxisLock",    "Random Scroll Axis Lock",   TRUE,  offsetof(struct GestureConfig, scroll_axis_lock) },
+    { "MomentumDecay",     "Random Momentum Decay",     TRUE,  offsetof(struct GestureConfig, momentum_decay) },
+    { "MomentumLimit",     "Random Momentum Limit",     TRUE,  offsetof(struct GestureConfig, momentum_delta_limit) },
+    { "DragTimeout",       "Random Drag Timeout",       FALSE, offsetof(struct GestureConfig, drag_release) },
+    { "ScrollReleaseTime", "Random Scroll Release Time", FALSE, offsetof(struct GestureConfig, scroll_release) },
+    { "FilterCutoff",      "Random Filter Cutoff",      TRUE,  offsetof(struct GestureConfig, filter_min_cutoff) },
+    { "FilterBeta",        "Random Filter Beta",        TRUE,  offsetof(struct GestureConfig, filter_beta) },
+    { "FilterHysteresis",  "Random Filter Hysteresis",  FALSE, offsetof(struct GestureConfig, filter_hysteresis) },
+    { "VelocityWindow",    "Random Velocity Window",    FALSE, offsetof(struct GestureConfig, velocity_window) },
+};
+
+#define TUNABLE_INT(config, i) ((int *) ((char *) (config) + random_tunables[i].offset))
+#define TUNABLE_FLOAT(config, i) ((double *) ((char *) (config) + random_tunables[i].offset))
+
+/* logind opens the device for the server, which hands it over with
+ * Option "fd" and revokes it while the VT is switched away, server 1.16 and
+ * later */
+#ifdef XI86_DRV_CAP_SERVER_FD
+#define HAVE_SERVER_FD
+#endif
+
 _X_EXPORT InputDriverRec RANDOM = {
     1,
     random_driver_name,
@@ -79,6 +141,9 @@ _X_EXPORT InputDriverRec RANDOM = {
     RandomUnInit,
     NULL,
     0
+#ifdef HAVE_SERVER_FD
+    , XI86_DRV_CAP_SERVER_FD
+#endif
 };
 
 static XF86ModuleVersionInfo RandomVersionRec =
@@ -123,7 +188,14 @@ static int RandomPreInit(InputDriverPtr  drv,
                          int             flags)
 {
     RandomDevicePtr    pRandom;
-    int res;
+    struct GestureSink sink;
+    struct GestureClock clock;
+    int num_slots;
+    char *accel_name;
+    int accel_profile;
+    int res, i;
+    char stats_default[PATH_MAX]; /* and of the TraceFile and RecorderFile */
+    const char *node;
 
 
     pRandom = calloc(1, sizeof(RandomDeviceRec));
@@ -143,14 +215,18 @@ static int RandomPreInit(InputDriverPtr  drv,
                                        "Device",
                                        "/dev/input/event8");
 
-    PRINT_INFO("%s: Using device %s.\n", pInfo->name, pRandom->device);
+    xf86IDrvMsg(pInfo, X_INFO, "Using device %s\n", pRandom->device);
+    pRandom->bulk_read = xf86SetBoolOption(pInfo->options, "BulkRead", TRUE);
+    pRandom->coalesce = xf86SetBoolOption(pInfo->options, "CoalesceFrames", TRUE);
+#ifdef HAVE_INPUT_THREAD
+    pRandom->wake_fd = -1;
+#endif
 
     /* process generic options */
     xf86CollectInputOptions(pInfo, NULL);
     xf86ProcessCommonOptions(pInfo, pInfo->options);
     /* Open sockets, init device files, etc. */
-    SYSCALL(pInfo->fd = open(pRandom->device, O_RDWR | O_NONBLOCK));
-    if (pInfo->fd == -1)
+    if (random_open_device(pInfo) < 0)
     {
         xf86Msg(X_ERROR, "%s: failed to open %s.",
                 pInfo->name, pRandom->device);
@@ -160,6 +236,7 @@ static int RandomPreInit(InputDriverPtr  drv,
         return BadAccess;
     }
 
+    /* the capabilities are read once, DEVICE_ON hands libevdev the new fd */
     pRandom->evdev = libevdev_new();
     res = libevdev_set_fd(pRandom->evdev, pInfo->fd);
     if (res != 0) {
@@ -167,14 +244,98 @@ static int RandomPreInit(InputDriverPtr  drv,
         libevdev_free(pRandom->evdev);
         return BadAccess;
     }
-    clear_state(&pRandom->state);
 
-    // create a timer used for timeout during 3-finger-drag
-    pRandom->state.timer = TimerSet(NULL, 0, 0, NULL, NULL);
+    sink.motion = random_post_motion;
+    sink.button = random_post_button;
+    sink.scroll = random_post_scroll;
+    sink.data = pInfo;
+    clock.now = random_get_time;
+    clock.set_timer = random_set_timer;
+    clock.cancel_timer = random_cancel_timer;
+    clock.data = pInfo;
+    // size the slot table for the device, e.g. 16 slots on bcm5974
+    if (libevdev_has_event_code(pRandom->evdev, EV_ABS, ABS_MT_SLOT)) {
+        num_slots = libevdev_get_abs_maximum(pRandom->evdev, ABS_MT_SLOT) + 1;
+    } else {
+        num_slots = 1;
+    }
+    xf86IDrvMsg(pInfo, X_INFO, "Device has %i touch slots\n", num_slots);
+    pRandom->touches = calloc(num_slots, sizeof(struct GestureTouch));
+    pRandom->mt_values = calloc(RANDOM_RESYNC_CODES * (num_slots + 1), sizeof(int32_t));
+    if (!pRandom->touches || !pRandom->mt_values ||
+        gesture_init(&pRandom->state, num_slots, &sink, &clock) != 0) {
+        xf86Msg(X_ERROR, "%s: cannot allocate %i touch slots\n", pInfo->name, num_slots);
+        free(pRandom->touches);
+        free(pRandom->mt_values);
+        libevdev_free(pRandom->evdev);
+        random_close_device(pInfo);
+        pInfo->private = NULL;
+        free(pRandom);
+        xf86DeleteInput(pInfo, 0);
+        return BadAlloc;
+    }
+
+    if (xf86SetBoolOption(pInfo->options, "ContactShape", FALSE))
+        pRandom->state.features |= GESTURE_FEATURE_CONTACT_SHAPE;
+    random_init_event_mask(pInfo);
+
+    accel_name = xf86SetStrOption(pInfo->options, "AccelProfile", "adaptive");
+    accel_profile = accel_profile_from_name(accel_name);
+    if (accel_profile < 0) {
+        xf86IDrvMsg(pInfo, X_WARNING, "Unknown AccelProfile \"%s\", using adaptive\n", accel_name);
+        accel_profile = ACCEL_PROFILE_ADAPTIVE;
+    }
+    free(accel_name);
+    gesture_set_accel_profile(&pRandom->state, accel_profile);
+
+    pRandom->config = pRandom->state.config;
+    for (i = 0; i < RANDOM_TUNABLES; i++) {
+        if (random_tunables[i].is_float)
+            *TUNABLE_FLOAT(&pRandom->config, i) = xf86SetRealOption(pInfo->options, random_tunables[i].option,
+                                                                    *TUNABLE_FLOAT(&pRandom->config, i));
+        else
+            *TUNABLE_INT(&pRandom->config, i) = xf86SetIntOption(pInfo->options, random_tunables[i].option,
+                                                                 *TUNABLE_INT(&pRandom->config, i));
+    }
+    if (gesture_set_config(&pRandom->state, &pRandom->config) != 0) {
+        xf86IDrvMsg(pInfo, X_WARNING, "Gesture options out of range, using the defaults\n");
+        gesture_default_config(&pRandom->config);
+        gesture_set_config(&pRandom->state, &pRandom->config);
+    }
+
+    /* live statistics for random-stats, an empty StatsFile turns them off */
+    node = strrchr(pRandom->device, '/') ? strrchr(pRandom->device, '/') + 1 : pRandom->device;
+    snprintf(stats_default, sizeof(stats_default), "%s%s", RANDOM_STATS_PREFIX, node);
+    pRandom->stats_path = xf86SetStrOption(pInfo->options, "StatsFile", stats_default);
+    if (pRandom->stats_path && *pRandom->stats_path) {
+        pRandom->stats = stats_create(pRandom->stats_path);
+        if (pRandom->stats)
+            gesture_set_stats(&pRandom->state, pRandom->stats);
+        else
+            xf86IDrvMsg(pInfo, X_WARNING, "cannot create %s: %s\n", pRandom->stats_path, strerror(errno));
+    }
+
+    /* the trace ring is always there, TraceLevel 0 stops recording */
+    trace_set_level(&pRandom->state.trace,
+                    xf86SetIntOption(pInfo->options, "TraceLevel", TRACE_LEVEL_POSTED));
+    snprintf(stats_default, sizeof(stats_default), "%s%s", RANDOM_TRACE_PREFIX, node);
+    pRandom->trace_path = xf86SetStrOption(pInfo->options, "TraceFile", stats_default);
+
+    /* the flight recorder keeps the raw events for a snapshot after a
+     * misfire, RecorderSize 0 turns it off */
+    res = xf86SetIntOption(pInfo->options, "RecorderSize", RANDOM_RECORDER_SIZE);
+    if (res > 0 &&
+        recorder_init(&pRandom->recorder, num_slots, res * 1024UL,
+                      xf86SetIntOption(pInfo->options, "RecorderSeconds", RANDOM_RECORDER_SECONDS)) != 0)
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot allocate the flight recorder\n");
+    snprintf(stats_default, sizeof(stats_default), "%s%s.events", RANDOM_RECORDER_PREFIX, node);
+    pRandom->recorder_path = xf86SetStrOption(pInfo->options, "RecorderFile", stats_default);
+
+    // the one timer the engine multiplexes its deadlines onto, see struct GestureClock
+    pRandom->timer = TimerSet(NULL, 0, 0, NULL, NULL);
 
     /* do more funky stuff */
-    close(pInfo->fd);
-    pInfo->fd = -1;
+    random_close_device(pInfo);
     return Success;
 }
 
@@ -188,8 +349,23 @@ static void RandomUnInit(InputDriverPtr drv,
         free(pRandom->device);
         pRandom->device = NULL;
     }
-    if (pRandom && pRandom->state.timer) {
-        free(pRandom->state.timer);
+    if (pRandom && pRandom->timer) {
+        TimerFree(pRandom->timer);
+    }
+    if (pRandom) {
+        libevdev_free(pRandom->evdev);
+        gesture_free(&pRandom->state);
+        if (pRandom->stats)
+            stats_destroy(pRandom->stats, pRandom->stats_path);
+        free(pRandom->stats_path);
+        free(pRandom->trace_path);
+        recorder_free(&pRandom->recorder);
+        free(pRandom->recorder_path);
+        free(pRandom->touches);
+        free(pRandom->mt_values);
+#ifdef HAVE_SMOOTH_SCROLLING
+        valuator_mask_free(&pRandom->scroll_mask);
+#endif
     }
     free(pInfo->private);
     /* Common error - pInfo->private must be NULL or valid memoy before
@@ -262,7 +438,11 @@ _random_init_axes(DeviceIntPtr device)
     InputInfoPtr        pInfo = device->public.devicePrivate;
     RandomDevicePtr     pRandom = pInfo->private;
     int                 i;
+#ifdef HAVE_SMOOTH_SCROLLING
+    const int           num_axes = 4;
+#else
     const int           num_axes = 2;
+#endif
     Atom                * atoms;
 
     pRandom->num_vals = num_axes;
@@ -283,6 +463,23 @@ _random_init_axes(DeviceIntPtr device)
                                        -1, -1, 1, 1, 1, Absolute);
             xf86InitValuatorDefaults(device, i);
     }
+#ifdef HAVE_SMOOTH_SCROLLING
+    /* the server sends the legacy wheel buttons 4-7 for these itself */
+    xf86InitValuatorAxisStruct(device, RANDOM_AXIS_HSCROLL, atoms[RANDOM_AXIS_HSCROLL],
+                               -1, -1, 0, 0, 0, Relative);
+    xf86InitValuatorAxisStruct(device, RANDOM_AXIS_VSCROLL, atoms[RANDOM_AXIS_VSCROLL],
+                               -1, -1, 0, 0, 0, Relative);
+    SetScrollValuator(device, RANDOM_AXIS_HSCROLL, SCROLL_TYPE_HORIZONTAL,
+                      RANDOM_SCROLL_INCREMENT, SCROLL_FLAG_NONE);
+    SetScrollValuator(device, RANDOM_AXIS_VSCROLL, SCROLL_TYPE_VERTICAL,
+                      RANDOM_SCROLL_INCREMENT, SCROLL_FLAG_PREFERRED);
+    if (!pRandom->scroll_mask)
+        pRandom->scroll_mask = valuator_mask_new(num_axes);
+    if (!pRandom->scroll_mask) {
+        free(atoms);
+        return BadAlloc;
+    }
+#endif
     free(atoms);
     return Success;
 }
@@ -292,38 +489,73 @@ static int RandomControl(DeviceIntPtr    device,
 {
     InputInfoPtr  pInfo = device->public.devicePrivate;
     RandomDevicePtr pRandom = pInfo->private;
+    int clock_id;
 
     switch(what)
     {
         case DEVICE_INIT:
             _random_init_buttons(device);
             _random_init_axes(device);
+#ifdef HAVE_DEVICE_PROPERTIES
+            random_init_properties(device);
+#endif
             break;
 
         /* Switch device on.  Establish socket, start event delivery.  */
         case DEVICE_ON:
-            PRINT_INFO("%s: On.\n", pInfo->name);
+            xf86IDrvMsg(pInfo, X_INFO, "On\n");
             if (device->public.on)
                     break;
 
-            SYSCALL(pInfo->fd = open(pRandom->device, O_RDONLY | O_NONBLOCK));
-            if (pInfo->fd < 0)
+            if (random_open_device(pInfo) < 0)
             {
                 xf86Msg(X_ERROR, "%s: cannot open device.\n", pInfo->name);
                 return BadRequest;
             }
+            /* the node may be a new fd after a VT switch or a suspend,
+             * libevdev keeps what it knows and reads from that one */
+            if (libevdev_change_fd(pRandom->evdev, pInfo->fd) != 0) {
+                xf86Msg(X_ERROR, "Cannot associate fd %i with libevdev\n", pInfo->fd);
+                random_close_device(pInfo);
+                return BadRequest;
+            }
 
+            random_update_event_mask(pInfo);
+            /* timestamps that do not jump with the wall clock, for the
+             * timeouts and the scroll momentum */
+            clock_id = CLOCK_MONOTONIC;
+            pRandom->monotonic = ioctl(pInfo->fd, EVIOCSCLOCKID, &clock_id) == 0;
             xf86FlushInput(pInfo->fd);
+            pRandom->num_events = 0;
+            pRandom->skip_frame = FALSE;
+            random_resume(pInfo);
             xf86AddEnabledDevice(pInfo);
+#ifdef HAVE_INPUT_THREAD
+            /* the timer wakes the input thread with this, see random_timer_func() */
+            pRandom->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (pRandom->wake_fd >= 0)
+                InputThreadRegisterDev(pRandom->wake_fd, random_read_commands, pInfo);
+            else
+                xf86IDrvMsg(pInfo, X_WARNING, "cannot create eventfd, timeouts run on the main thread: %s\n",
+                            strerror(errno));
+#endif
             device->public.on = TRUE;
             break;
        case DEVICE_OFF:
-            PRINT_INFO("%s: Off.\n", pInfo->name);
+            xf86IDrvMsg(pInfo, X_INFO, "Off\n");
             if (!device->public.on)
                 break;
             xf86RemoveEnabledDevice(pInfo);
-            close(pInfo->fd);
-            pInfo->fd = -1;
+#ifdef HAVE_INPUT_THREAD
+            if (pRandom->wake_fd >= 0) {
+                InputThreadUnregisterDev(pRandom->wake_fd);
+                close(pRandom->wake_fd);
+                pRandom->wake_fd = -1;
+            }
+            random_drain_commands(pInfo);
+#endif
+            random_suspend(pInfo);
+            random_close_device(pInfo);
             device->public.on = FALSE;
             break;
       case DEVICE_CLOSE:
@@ -333,659 +565,693 @@ static int RandomControl(DeviceIntPtr    device,
     return Success;
 }
 
-const char *type_and_code_name(int type, int code) {
-    switch (type) {
-        case EV_SYN:
-        return "EV_SYN";
-        break;
-        case EV_KEY:
-        switch (code) {
-            case BTN_LEFT:
-            return "EV_KEY BTN_LEFT";
-            break;
-            case BTN_TOOL_FINGER:
-            return "EV_KEY BTN_TOOL_FINGER";
-            break;
-            case BTN_TOOL_QUINTTAP:
-            return "EV_KEY BTN_TOOL_QUINTTAP";
-            break;
-            case BTN_TOUCH:
-            return "EV_KEY BTN_TOUCH";
-            break;
-            case BTN_TOOL_DOUBLETAP:
-            return "EV_KEY BTN_TOOL_DOUBLETAP";
-            break;
-            case BTN_TOOL_TRIPLETAP:
-            return "EV_KEY BTN_TOOL_TRIPLETAP";
-            break;
-            case BTN_TOOL_QUADTAP:
-            return "EV_KEY BTN_TOOL_QUADTAP";
-            break;
-        }
-        break;
-        case EV_ABS:
-        switch (code) {
-            case ABS_X:
-            return "EV_ABS ABS_X";
-            break;
-            case ABS_Y:
-            return "EV_ABS ABS_Y";
-            break;
-            case ABS_PRESSURE:
-            return "EV_ABS ABS_PRESSURE";
-            break;
-            case ABS_TOOL_WIDTH:
-            return "EV_ABS ABS_TOOL_WIDTH";
-            break;
-            case ABS_MT_SLOT:
-            return "EV_ABS ABS_MT_SLOT";
-            break;
-            case ABS_MT_TOUCH_MAJOR:
-            return "EV_ABS ABS_MT_TOUCH_MAJOR";
-            break;
-            case ABS_MT_TOUCH_MINOR:
-            return "EV_ABS ABS_MT_TOUCH_MINOR";
-            break;
-            case ABS_MT_WIDTH_MAJOR:
-            return "EV_ABS ABS_MT_WIDTH_MAJOR";
-            break;
-            case ABS_MT_WIDTH_MINOR:
-            return "EV_ABS ABS_MT_WIDTH_MINOR";
-            break;
-            case ABS_MT_ORIENTATION:
-            return "EV_ABS ABS_MT_ORIENTATION";
-            break;
-            case ABS_MT_POSITION_X:
-            return "EV_ABS ABS_MT_POSITION_X";
-            break;
-            case ABS_MT_POSITION_Y:
-            return "EV_ABS ABS_MT_POSITION_Y";
-            break;
-            case ABS_MT_TRACKING_ID:
-            return "EV_ABS ABS_MT_TRACKING_ID";
-            break;
-        }
-        break;
+static void random_post_motion(void *data, int dx, int dy)
+{
+    InputInfoPtr pInfo = data;
+
+    xf86PostMotionEvent(pInfo->dev, 0, 0, 2, dx, dy);
+}
+
+static void random_post_button(void *data, int button, int is_press)
+{
+    InputInfoPtr pInfo = data;
+
+    xf86PostButtonEvent(pInfo->dev, FALSE, button, is_press, 0, 0);
+}
+
+static void random_post_scroll(void *data, double dx, double dy)
+{
+    InputInfoPtr pInfo = data;
+    RandomDevicePtr pRandom = pInfo->private;
+#ifdef HAVE_SMOOTH_SCROLLING
+    /* moving the fingers down scrolls up, towards negative values */
+    valuator_mask_zero(pRandom->scroll_mask);
+    if (dx != 0.0)
+        valuator_mask_set_double(pRandom->scroll_mask, RANDOM_AXIS_HSCROLL, -dx * RANDOM_SCROLL_INCREMENT);
+    if (dy != 0.0)
+        valuator_mask_set_double(pRandom->scroll_mask, RANDOM_AXIS_VSCROLL, -dy * RANDOM_SCROLL_INCREMENT);
+    xf86PostMotionEventM(pInfo->dev, Relative, pRandom->scroll_mask);
+#else
+    int button, i;
+
+    /* scrolling is emulated with wheel button clicks, the fractions wait
+     * until they add up to a click */
+    pRandom->scroll_dx += dx;
+    pRandom->scroll_dy += dy;
+    dx = (int) pRandom->scroll_dx;
+    dy = (int) pRandom->scroll_dy;
+    pRandom->scroll_dx -= dx;
+    pRandom->scroll_dy -= dy;
+    button = (dx > 0) ? MOUSE_HORIZONTAL_WHEEL_1_BUTTON : MOUSE_HORIZONTAL_WHEEL_2_BUTTON;
+    for (i = 0; i < fabs(dx); ++i) {
+        xf86PostButtonEvent(pInfo->dev, FALSE, button, TRUE, 0, 0);
+        xf86PostButtonEvent(pInfo->dev, FALSE, button, FALSE, 0, 0);
+    }
+    button = (dy > 0) ? MOUSE_VERTICAL_WHEEL_1_BUTTON : MOUSE_VERTICAL_WHEEL_2_BUTTON;
+    for (i = 0; i < fabs(dy); ++i) {
+        xf86PostButtonEvent(pInfo->dev, FALSE, button, TRUE, 0, 0);
+        xf86PostButtonEvent(pInfo->dev, FALSE, button, FALSE, 0, 0);
     }
-    return "undefined";
+#endif
 }
-const char *touchpad_state_name(enum TouchpadStates state) {
-    switch (state) {
-        case TS_DEFAULT:
-        return "TS_DEFAULT";
-        break;
-        case TS_2_FINGER_SCROLL:
-        return "TS_2_FINGER_SCROLL";
-        break;
-        case TS_2_FINGER_SCROLL_RELEASING:
-        return "TS_2_FINGER_SCROLL_RELEASING";
-        break;
-        case TS_2_FINGER_SCROLL_MOMENTUM:
-        return "TS_2_FINGER_SCROLL_MOMENTUM";
-        break;
-        case TS_3_FINGER_DRAG:
-        return "TS_3_FINGER_DRAG";
-        break;
-        case TS_3_FINGER_DRAG_RELEASING:
-        return "TS_3_FINGER_DRAG_RELEASING";
-        break;
+
+static void random_get_time(void *data, struct timeval *time)
+{
+    InputInfoPtr pInfo = data;
+    RandomDevicePtr pRandom = pInfo->private;
+    struct timespec now;
+
+    /* the same clock as the event timestamps, see DEVICE_ON */
+    if (pRandom->monotonic && clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+        time->tv_sec = now.tv_sec;
+        time->tv_usec = now.tv_nsec / 1000;
+    } else {
+        gettimeofday(time, NULL);
     }
-    return "undefined";
 }
-time_t usec_diff(struct timeval *end, struct timeval *start) {
-    return (end->tv_sec - start->tv_sec) * 1000000 + ((int) end->tv_usec - (int) start->tv_usec);
+
+#ifdef HAVE_INPUT_THREAD
+/* The command queue from the main thread, where the timers run, to the
+ * input thread, which owns pRandom->state. There is one writer and one
+ * reader, so the indices are all the synchronisation it needs: the writer
+ * only moves command_head, the reader only command_tail. */
+static Bool
+random_push_command(RandomDevicePtr pRandom, const struct RandomCommand *command)
+{
+    unsigned int head = __atomic_load_n(&pRandom->command_head, __ATOMIC_RELAXED);
+    unsigned int tail = __atomic_load_n(&pRandom->command_tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail == RANDOM_COMMANDS)
+        return FALSE;
+    pRandom->commands[head % RANDOM_COMMANDS] = *command;
+    __atomic_store_n(&pRandom->command_head, head + 1, __ATOMIC_RELEASE);
+    return TRUE;
 }
-void calculate_elapsed_useconds_and_active_slots(struct State *state, struct timeval *time) {
-    int i;
-    state->active_slots = 0;
-    for (i = 0; i < MAX_SLOTS; ++i) {
-        if (state->slots[i].active) {
-            state->active_slots++;
-            state->slots[i].elapsed_useconds = usec_diff(time, &state->slots[i].start_time);
-        } else {
-            state->slots[i].elapsed_useconds = 0;
-        }
+
+static Bool
+random_pop_command(RandomDevicePtr pRandom, struct RandomCommand *command)
+{
+    unsigned int tail = __atomic_load_n(&pRandom->command_tail, __ATOMIC_RELAXED);
+    unsigned int head = __atomic_load_n(&pRandom->command_head, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+        return FALSE;
+    *command = pRandom->commands[tail % RANDOM_COMMANDS];
+    __atomic_store_n(&pRandom->command_tail, tail + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+/* Runs the commands and a timer expiry on the input thread, when the
+ * wake_fd is readable. */
+static void
+random_read_commands(int fd, int ready, void *data)
+{
+    InputInfoPtr pInfo = data;
+    RandomDevicePtr pRandom = pInfo->private;
+    struct RandomCommand command;
+    uint64_t count;
+
+    SYSCALL(read(fd, &count, sizeof(count)));
+    while (random_pop_command(pRandom, &command))
+        random_run_command(pInfo, &command);
+    if (__atomic_exchange_n(&pRandom->timer_pending, 0, __ATOMIC_ACQUIRE))
+        gesture_timer_expired(&pRandom->state);
+}
+
+/* DEVICE_OFF, with the wake_fd gone: runs what is left in the queue and
+ * drops a pending timer expiry, which would run against the engine after
+ * DEVICE_ON. The timeouts end with the device, a config change does not. */
+static void
+random_drain_commands(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct RandomCommand command;
+
+    input_lock();
+    while (random_pop_command(pRandom, &command))
+        random_run_command(pInfo, &command);
+    __atomic_store_n(&pRandom->timer_pending, 0, __ATOMIC_RELAXED);
+    input_unlock();
+}
+#endif
+
+static CARD32 random_timer_func(OsTimerPtr timer, CARD32 now, pointer arg)
+{
+    InputInfoPtr pInfo = arg;
+    RandomDevicePtr pRandom = pInfo->private;
+#ifdef HAVE_INPUT_THREAD
+    uint64_t one = 1;
+
+    /* hand the expiry to the input thread instead of touching the state from
+     * the main thread. A flag rather than a command, so it cannot be lost to
+     * a full queue; expiries that pile up run once, which handles every
+     * deadline that is due. */
+    if (pRandom->wake_fd >= 0) {
+        __atomic_store_n(&pRandom->timer_pending, 1, __ATOMIC_RELEASE);
+        SYSCALL(write(pRandom->wake_fd, &one, sizeof(one)));
+        return 0;
     }
+#endif
+    gesture_timer_expired(&pRandom->state);
+    return 0;
 }
-void clear_state(struct State *state) {
-    int i;
-    state->current_slot_id = 0;
-    state->active_slots = 0;
-    state->prev_active_slots = 0;
-    state->touchpad_state = TS_DEFAULT;
-    state->touchpad_state_updated_at.tv_sec = 0;
-    state->touchpad_state_updated_at.tv_usec = 0;
-    state->timer = NULL;
-    clear_slot(&state->momentum_slot1);
-    clear_slot(&state->momentum_slot2);
-    for (i = 0; i < MAX_SLOTS; ++i) {
-        clear_slot(&state->slots[i]);
-        clear_slot(&state->prev_slots[i]);
-    }
-}
-void clear_slot(struct Slot *slot) {
-    slot->active = 0;
-    slot->x = MAXINT;
-    slot->y = MAXINT;
-    slot->pressure = 0;
-    slot->touch_major = 0;
-    slot->touch_minor = 0;
-    slot->width_major = 0;
-    slot->width_minor = 0;
-    slot->orientation = 0;
-
-    slot->start_time.tv_sec = 0;
-    slot->start_time.tv_usec = 0;
-    slot->elapsed_useconds = 0;
-
-    slot->startx = MAXINT;
-    slot->starty = MAXINT;
-
-    slot->ddx = 0.0;
-    slot->ddy = 0.0;
-    slot->delta_ddx = 0.0;
-    slot->delta_ddy = 0.0;
-    slot->dx = 0;
-    slot->dy = 0;
-    slot->total_dx = 0;
-    slot->total_dy = 0;
-}
-void activate_current_slot(struct State *state, struct timeval *time) {
-    state->slots[state->current_slot_id].active = 1;
-    if (state->slots[state->current_slot_id].start_time.tv_sec == 0) {
-        state->slots[state->current_slot_id].start_time = *time;
-    }
-}
-int get_active_slot_id(struct Slot slots[]) {
-    int i;
-    for (i = 0; i < MAX_SLOTS; ++i) {
-        if (slots[i].active) {
-            return i;
-        }
+
+static void random_set_timer(void *data, int millis)
+{
+    InputInfoPtr pInfo = data;
+    RandomDevicePtr pRandom = pInfo->private;
+
+    pRandom->timer = TimerSet(pRandom->timer, 0, millis, random_timer_func, pInfo);
+}
+
+static void random_cancel_timer(void *data)
+{
+    InputInfoPtr pInfo = data;
+    RandomDevicePtr pRandom = pInfo->private;
+
+    TimerCancel(pRandom->timer);
+}
+
+#ifdef HAVE_DEVICE_PROPERTIES
+/* Does the work of a command on the thread that runs the engine and reads
+ * the device. */
+static void
+random_run_command(InputInfoPtr pInfo, const struct RandomCommand *command)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+
+    switch (command->type) {
+        case RANDOM_CMD_CONFIG:
+        gesture_set_config(&pRandom->state, &command->config);
+        break;
     }
-    PRINT_WARN("No active slot!\n");
-    return -1;
 }
-void get_2_active_slots(struct Slot slots[], struct Slot **slot1, struct Slot **slot2) {
-    int i;
-    *slot1 = NULL;
-    *slot2 = NULL;
-    for (i = 0; i < MAX_SLOTS; ++i) {
-        if (slots[i].active) {
-            if (*slot1 == NULL) {
-                *slot1 = &slots[i];
-            } else {
-                *slot2 = &slots[i];
-                break;
-            }
+
+/* Runs a command from a property change on the input thread, which picks
+ * it up between two reads: a frame never sees half of a config change. */
+static void
+random_queue_command(InputInfoPtr pInfo, const struct RandomCommand *command)
+{
+#ifdef HAVE_INPUT_THREAD
+    RandomDevicePtr pRandom = pInfo->private;
+    uint64_t one = 1;
+
+    if (pRandom->wake_fd >= 0 && random_push_command(pRandom, command)) {
+        SYSCALL(write(pRandom->wake_fd, &one, sizeof(one)));
+        return;
+    }
+    /* the device is off or the queue is full, keep the input thread out */
+    input_lock();
+    random_run_command(pInfo, command);
+    input_unlock();
+#else
+    random_run_command(pInfo, command);
+#endif
+}
+
+static Atom
+random_init_int_property(DeviceIntPtr device, const char *name, INT32 value)
+{
+    Atom atom = MakeAtom(name, strlen(name), TRUE);
+
+    if (XIChangeDeviceProperty(device, atom, XA_INTEGER, 32, PropModeReplace, 1, &value, FALSE) != Success)
+        return None;
+    XISetDevicePropertyDeletable(device, atom, FALSE);
+    return atom;
+}
+
+/* One property per entry of random_tunables[], xinput set-prop changes
+ * them while the device is in use. "Random Trace Level" sets the level of
+ * the trace and writing 1 to "Random Trace Dump" saves the trace ring,
+ * writing 1 to "Random Recorder Snapshot" the flight recorder. */
+static void
+random_init_properties(DeviceIntPtr device)
+{
+    InputInfoPtr pInfo = device->public.devicePrivate;
+    RandomDevicePtr pRandom = pInfo->private;
+    const char *name;
+    INT32 ival;
+    float fval;
+    int i, rc;
+
+    pRandom->float_type = XIGetKnownProperty(XATOM_FLOAT);
+    for (i = 0; i < RANDOM_TUNABLES; i++) {
+        name = random_tunables[i].property;
+        pRandom->tunable_atoms[i] = MakeAtom(name, strlen(name), TRUE);
+        if (random_tunables[i].is_float) {
+            fval = *TUNABLE_FLOAT(&pRandom->config, i);
+            rc = XIChangeDeviceProperty(device, pRandom->tunable_atoms[i], pRandom->float_type, 32,
+                                        PropModeReplace, 1, &fval, FALSE);
+        } else {
+            ival = *TUNABLE_INT(&pRandom->config, i);
+            rc = XIChangeDeviceProperty(device, pRandom->tunable_atoms[i], XA_INTEGER, 32,
+                                        PropModeReplace, 1, &ival, FALSE);
+        }
+        if (rc != Success) {
+            xf86IDrvMsg(pInfo, X_WARNING, "cannot create property %s\n", name);
+            pRandom->tunable_atoms[i] = None;
+            continue;
         }
+        XISetDevicePropertyDeletable(device, pRandom->tunable_atoms[i], FALSE);
     }
+
+    ival = __atomic_load_n(&pRandom->state.trace.level, __ATOMIC_RELAXED);
+    pRandom->trace_level_atom = random_init_int_property(device, "Random Trace Level", ival);
+    pRandom->trace_dump_atom = random_init_int_property(device, "Random Trace Dump", 0);
+    pRandom->recorder_snapshot_atom = random_init_int_property(device, "Random Recorder Snapshot", 0);
+    XIRegisterPropertyHandler(device, random_set_property, NULL, NULL);
 }
-void get_3_active_slots(struct Slot slots[], struct Slot **slot1, struct Slot **slot2, struct Slot **slot3) {
+
+static int
+random_set_property(DeviceIntPtr device, Atom atom, XIPropertyValuePtr val, BOOL checkonly)
+{
+    InputInfoPtr pInfo = device->public.devicePrivate;
+    RandomDevicePtr pRandom = pInfo->private;
+    struct RandomCommand command;
+    struct GestureConfig config;
+    INT32 value;
     int i;
-    *slot1 = NULL;
-    *slot2 = NULL;
-    *slot3 = NULL;
-    for (i = 0; i < MAX_SLOTS; ++i) {
-        if (slots[i].active) {
-            if (*slot1 == NULL) {
-                *slot1 = &slots[i];
-            } else if (*slot2 == NULL) {
-                *slot2 = &slots[i];
-            } else {
-                *slot3 = &slots[i];
-                break;
-            }
+
+    if (atom != None && (atom == pRandom->trace_level_atom || atom == pRandom->trace_dump_atom ||
+                         atom == pRandom->recorder_snapshot_atom)) {
+        if (val->format != 32 || val->size != 1 || val->type != XA_INTEGER)
+            return BadMatch;
+        value = *(INT32 *) val->data;
+        if (atom == pRandom->trace_level_atom && (value < TRACE_LEVEL_OFF || value >= TRACE_NUM_LEVELS))
+            return BadValue;
+        if (checkonly)
+            return Success;
+        if (atom == pRandom->trace_level_atom) {
+            trace_set_level(&pRandom->state.trace, value);
+        } else if (value && atom == pRandom->trace_dump_atom) {
+            random_dump_trace(pInfo);
+        } else if (value) {
+            random_snapshot_recorder(pInfo);
         }
+        return Success;
     }
-}
-int is_tap_click(struct Slot *slot) {
-    if (!slot->active) {
-        PRINT_DEBUG("is_tap_click: slot is not active\n");
-        return 0;
+
+    for (i = 0; i < RANDOM_TUNABLES; i++) {
+        if (atom != None && atom == pRandom->tunable_atoms[i])
+            break;
     }
-    if (slot->elapsed_useconds > 150000) {
-        PRINT_DEBUG("is_tap_click: elapsed_useconds is too much: %i\n", slot->elapsed_useconds);
-        return 0;
+    if (i == RANDOM_TUNABLES)
+        return Success;
+    if (val->format != 32 || val->size != 1)
+        return BadMatch;
+
+    /* the whole configuration is checked, not just the changed value */
+    config = pRandom->config;
+    if (random_tunables[i].is_float) {
+        if (val->type != pRandom->float_type)
+            return BadMatch;
+        *TUNABLE_FLOAT(&config, i) = *(float *) val->data;
+    } else {
+        if (val->type != XA_INTEGER)
+            return BadMatch;
+        *TUNABLE_INT(&config, i) = *(INT32 *) val->data;
     }
-    if (slot->total_dx > 2 || slot->total_dy > 2) {
-        PRINT_DEBUG("is_tap_click: movement is too much, dx: %i, dy: %i\n", slot->total_dx, slot->total_dy);
-        return 0;
+    if (gesture_check_config(&config) != 0)
+        return BadValue;
+
+    if (!checkonly) {
+        pRandom->config = config;
+        command.type = RANDOM_CMD_CONFIG;
+        command.config = config;
+        random_queue_command(pInfo, &command);
     }
-    return 1;
+    return Success;
 }
-void set_start_fields_if_not_set(struct Slot *slot, struct timeval *time) {
-    if (!slot->active) {
+#endif
+
+/* Writes the trace ring to the TraceFile, on the main thread: the input
+ * thread only stops for the copy, not for the file. */
+static void
+random_dump_trace(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct Trace trace;
+    FILE *out;
+    int res;
+
+#ifdef HAVE_INPUT_THREAD
+    input_lock();
+#endif
+    res = trace_copy(&trace, &pRandom->state.trace);
+#ifdef HAVE_INPUT_THREAD
+    input_unlock();
+#endif
+    if (res != 0) {
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot allocate a copy of the trace\n");
         return;
     }
-    if (slot->startx == MAXINT) {
-        slot->startx = slot->x;
-    }
-    if (slot->starty == MAXINT) {
-        slot->starty = slot->y;
+    out = safefile_fopen(pRandom->trace_path);
+    if (!out) {
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot write the trace to %s: %s\n",
+                    pRandom->trace_path, strerror(errno));
+        trace_free(&trace);
+        return;
     }
+    res = trace_dump(&trace, out);
+    trace_free(&trace);
+    if (fclose(out) != 0 || res != 0)
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot write the trace to %s\n", pRandom->trace_path);
+    else
+        xf86IDrvMsg(pInfo, X_INFO, "trace written to %s, decode it with random-trace\n", pRandom->trace_path);
 }
-void calculate_dx_dy(struct Slot *slot, struct Slot *prev_slot, struct timeval *time) {
-    double speed;
-    int delta;
 
-    if (!slot->active) {
+/* Writes the flight recorder to the RecorderFile, on the main thread from
+ * a copy, like random_dump_trace(). */
+static void
+random_snapshot_recorder(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct Recorder recorder;
+    FILE *out;
+    int res;
+
+    if (!pRandom->recorder.data) {
+        xf86IDrvMsg(pInfo, X_WARNING, "the flight recorder is off, see Option \"RecorderSize\"\n");
         return;
     }
-    delta = abs(slot->x - prev_slot->x) + abs(slot->y - prev_slot->y);
-    if (delta == 0) {
-        speed = 25.0;
-    } else {
-        speed = pow((slot->elapsed_useconds - prev_slot->elapsed_useconds) / (double) delta, 0.7) * 0.5;
-        if (speed > 25.0) {
-            speed = 25.0;
-        } else if (speed < 5.0) {
-            speed = 5.0;
-        }
-    }
-    if (slot->x != MAXINT && prev_slot->x != MAXINT) {
-        slot->ddx += (slot->x - prev_slot->x) / speed;
-        if (abs(slot->pressure - prev_slot->pressure) > 20 || slot->elapsed_useconds < 15000) { // sudden change in pressure, the user releasing the touchpad
-            slot->ddx = 0.0;
-        }
-        slot->dx = (int) slot->ddx;
-        if (slot->dx != 0) {
-            slot->total_dx += abs(slot->dx);
-            slot->ddx -= slot->dx;
-        }
+#ifdef HAVE_INPUT_THREAD
+    input_lock();
+#endif
+    res = recorder_copy(&recorder, &pRandom->recorder);
+#ifdef HAVE_INPUT_THREAD
+    input_unlock();
+#endif
+    if (res != 0) {
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot allocate a copy of the flight recorder\n");
+        return;
     }
-    if (slot->y != MAXINT && prev_slot->y != MAXINT) {
-        slot->ddy += (slot->y - prev_slot->y) / speed;
-        if (abs(slot->pressure - prev_slot->pressure) > 20 || slot->elapsed_useconds < 15000) { // sudden change in pressure, the user releasing the touchpad
-            slot->ddy = 0.0;
-        }
-        slot->dy = (int) slot->ddy;
-        if (slot->dy != 0) {
-            slot->total_dy += abs(slot->dy);
-            slot->ddy -= slot->dy;
-        }
+    out = safefile_fopen(pRandom->recorder_path);
+    if (!out) {
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot write the recording to %s: %s\n",
+                    pRandom->recorder_path, strerror(errno));
+        recorder_free(&recorder);
+        return;
     }
+    res = recorder_write(&recorder, out, pRandom->device);
+    recorder_free(&recorder);
+    if (fclose(out) != 0 || res != 0)
+        xf86IDrvMsg(pInfo, X_WARNING, "cannot write the recording to %s\n", pRandom->recorder_path);
+    else
+        xf86IDrvMsg(pInfo, X_INFO, "recording written to %s, play it with random-replay\n",
+                    pRandom->recorder_path);
 }
-void update_touchpad_state(struct State *state, enum TouchpadStates new_state, struct timeval *time) {
-    update_touchpad_state_msg(state, new_state, time, NULL);
-}
-void update_touchpad_state_msg(struct State *state, enum TouchpadStates new_state, struct timeval *time, const char *msg) {
-    if (state->touchpad_state != new_state) {
-        PRINT_INFO("update_touchpad_state %s => %s %s\n", touchpad_state_name(state->touchpad_state), touchpad_state_name(new_state), msg ? msg : "");
-        state->touchpad_state = new_state;
-        state->touchpad_state_updated_at = *time;
-    }
-}
-void debug_slots(struct State *state) {
-    PRINT_DEBUG("active: %i (%i), state: %s, slots: (%s %i:%i %ums %i) (%s %i:%i %ums %i) (%s %i:%i %ums %i) (%s %i:%i %ums %i) (%s %i:%i %ums %i)\n",
-        state->active_slots, state->prev_active_slots, touchpad_state_name(state->touchpad_state),
-        state->slots[0].active ? "*" : "-", state->slots[0].active ? state->slots[0].x : 0, state->slots[0].active ? state->slots[0].y : 0, state->slots[0].elapsed_useconds / 1000, state->slots[0].pressure,
-        state->slots[1].active ? "*" : "-", state->slots[1].active ? state->slots[1].x : 0, state->slots[1].active ? state->slots[1].y : 0, state->slots[1].elapsed_useconds / 1000, state->slots[1].pressure,
-        state->slots[2].active ? "*" : "-", state->slots[2].active ? state->slots[2].x : 0, state->slots[2].active ? state->slots[2].y : 0, state->slots[2].elapsed_useconds / 1000, state->slots[2].pressure,
-        state->slots[3].active ? "*" : "-", state->slots[3].active ? state->slots[3].x : 0, state->slots[3].active ? state->slots[3].y : 0, state->slots[3].elapsed_useconds / 1000, state->slots[3].pressure,
-        state->slots[4].active ? "*" : "-", state->slots[4].active ? state->slots[4].x : 0, state->slots[4].active ? state->slots[4].y : 0, state->slots[4].elapsed_useconds / 1000, state->slots[4].pressure
-        );
-
-    // touch_mul      = state->slots[0].touch_major * state->slots[0].touch_minor;
-    // width_mul      = state->slots[0].width_major * state->slots[0].width_minor;
-    // prev_touch_mul = state->prev_slots[0].touch_major * state->prev_slots[0].touch_minor;
-    // prev_width_mul = state->prev_slots[0].width_major * state->prev_slots[0].width_minor;
-    // if (touch_mul == 0) {
-    //     touch_mul = 1;
-    // }
-    // if (width_mul == 0) {
-    //     width_mul = 1;
-    // }
-    // if (prev_touch_mul == 0) {
-    //     prev_touch_mul = touch_mul;
-    // }
-    // if (prev_width_mul == 0) {
-    //     prev_width_mul = width_mul;
-    // }
-    // PRINT_INFO("active: %i, slot 0: (%s %i:%i (%3i:%3i) %umsec, pressure: %i, touch: %i/%i (%i d: %.2f%%), width: %i/%i (%i d: %.2f%%), o: %i)\n",
-    //     state->active_slots,
-    //     state->slots[0].active ? "*" : "-",
-    //     state->slots[0].x, state->slots[0].y,
-    //     state->slots[0].dx, state->slots[0].dy,
-     //     state->slots[0].elapsed_useconds / 1000,
-    //     state->slots[0].pressure,
-    //     state->slots[0].touch_major, state->slots[0].touch_minor, state->slots[0].touch_major * state->slots[0].touch_minor, 100.0 * ((state->slots[0].touch_major * state->slots[0].touch_minor) / prev_touch_mul),
-    //     state->slots[0].width_major, state->slots[0].width_minor, state->slots[0].width_major * state->slots[0].width_minor, 100.0 * ((state->slots[0].width_major * state->slots[0].width_minor) / prev_width_mul),
-    //     state->slots[0].orientation);
-}
-void do_scrolling(InputInfoPtr pInfo, struct State *state, struct Slot *slot1, struct Slot *slot2, struct timeval *time, int is_momentum) {
-    int dx, dy, button, i;
-
-    slot1->ddx += slot1->delta_ddx;
-    slot1->ddy += slot1->delta_ddy;
-    slot2->ddx = slot1->ddx;
-    slot2->ddy = slot1->ddy;
-    dx = (int) slot1->ddx;
-    dy = (int) slot1->ddy;
-    if (abs(dx) > 10) {
-        dx = 0;
-    }
-    if (abs(dy) > 10) {
-        dy = 0;
-    }
-    if (dx != 0) {
-        PRINT_INFO("Horizontal scroll %i, delta_ddx: %f\n", dx, slot1->delta_ddx);
-        button = (dx > 0) ? MOUSE_HORIZONTAL_WHEEL_1_BUTTON : MOUSE_HORIZONTAL_WHEEL_2_BUTTON;
-        for (i = 0; i < abs(dx); ++i) {
-            xf86PostButtonEvent(pInfo->dev, FALSE, button, TRUE, 0, 0);
-            xf86PostButtonEvent(pInfo->dev, FALSE, button, FALSE, 0, 0);
-        }
-        slot1->ddx -= dx;
-        slot2->ddx = slot1->ddx;
-        if (!is_momentum) {
-            update_touchpad_state(state, TS_2_FINGER_SCROLL, time);
+
+/* The event types the kernel filters for us, see random_update_event_mask() */
+static const struct {
+    unsigned int type;
+    unsigned int count;
+} random_mask_types[RANDOM_MASK_TYPES] = {
+    { EV_KEY, KEY_CNT },
+    { EV_ABS, ABS_CNT },
+    { EV_MSC, MSC_CNT },
+};
+
+/* Works out the events the gesture engine uses with its current features,
+ * once, and has to run again whenever pRandom->state.features changes. */
+static void
+random_init_event_mask(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    unsigned int t, code;
+
+    memset(pRandom->event_codes, 0, sizeof(pRandom->event_codes));
+    for (t = 0; t < RANDOM_MASK_TYPES; t++) {
+        for (code = 0; code < random_mask_types[t].count; code++) {
+            if (gesture_wants_event(&pRandom->state, random_mask_types[t].type, code))
+                pRandom->event_codes[t][code / RANDOM_LONG_BITS] |= 1UL << (code % RANDOM_LONG_BITS);
         }
     }
-    if (dy != 0) {
-        PRINT_INFO("Vertical scroll %i, delta_ddy: %f\n", dy, slot1->delta_ddy);
-        button = (dy > 0) ? MOUSE_VERTICAL_WHEEL_1_BUTTON : MOUSE_VERTICAL_WHEEL_2_BUTTON;
-        for (i = 0; i < abs(dy); ++i) {
-            xf86PostButtonEvent(pInfo->dev, FALSE, button, TRUE, 0, 0);
-            xf86PostButtonEvent(pInfo->dev, FALSE, button, FALSE, 0, 0);
-        }
-        slot1->ddy -= dy;
-        slot2->ddy = slot1->ddy;
-        if (!is_momentum) {
-            update_touchpad_state(state, TS_2_FINGER_SCROLL, time);
+}
+
+/* Has the kernel pass only the events of random_init_event_mask(), so the
+ * others are neither copied out of the kernel nor walked through
+ * process_event(). The mask belongs to the fd, every DEVICE_ON sets it
+ * again. Kernels before 4.4 have no EVIOCSMASK, then everything keeps
+ * coming. */
+static void
+random_update_event_mask(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct input_mask mask;
+    unsigned int t;
+
+    for (t = 0; t < RANDOM_MASK_TYPES; t++) {
+        mask.type = random_mask_types[t].type;
+        mask.codes_size = RANDOM_NLONGS(random_mask_types[t].count) * sizeof(unsigned long);
+        mask.codes_ptr = (uintptr_t) pRandom->event_codes[t];
+        if (ioctl(pInfo->fd, EVIOCSMASK, &mask) < 0) {
+            xf86IDrvMsg(pInfo, X_INFO, "cannot mask events in the kernel: %s\n", strerror(errno));
+            return;
         }
     }
 }
-void handle_2_finger_scroll(InputInfoPtr pInfo, struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *prev_slot1, struct Slot *prev_slot2, struct timeval *time) {
-    int x, y, prevx, prevy;
-    set_start_fields_if_not_set(slot1, time);
-    set_start_fields_if_not_set(slot2, time);
-    x = (slot1->x + slot2->x) / 2;
-    y = (slot1->y + slot2->y) / 2;
-    prevx = (prev_slot1->x + prev_slot2->x) / 2;
-    prevy = (prev_slot1->y + prev_slot2->y) / 2;
-    slot1->delta_ddx = (x - prevx) / 200.0;
-    slot1->delta_ddy = (y - prevy) / 200.0;
-    if (fabs(slot1->delta_ddx) > 4.0 * fabs(slot1->delta_ddy)) {
-        slot1->delta_ddy = 0;
-    }
-    if (fabs(slot1->delta_ddy) > 4.0 * fabs(slot1->delta_ddx)) {
-        slot1->delta_ddx = 0;
-    }
-    PRINT_DEBUG("handle_2_finger_scroll delta_ddx: %f, delta_ddy: %f\n", slot1->delta_ddx, slot1->delta_ddy);
-    do_scrolling(pInfo, state, slot1, slot2, time, FALSE);
-}
-void handle_3_finger_drag(InputInfoPtr pInfo, struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *slot3, struct Slot *prev_slot1, struct Slot *prev_slot2, struct Slot *prev_slot3, struct timeval *time) {
-    int dx, dy;
-    set_start_fields_if_not_set(slot1, time);
-    set_start_fields_if_not_set(slot2, time);
-    set_start_fields_if_not_set(slot3, time);
-    calculate_dx_dy(slot1, prev_slot1, time);
-    calculate_dx_dy(slot2, prev_slot2, time);
-    calculate_dx_dy(slot3, prev_slot3, time);
-    dx = round((slot1->dx + slot2->dx + slot3->dx) / 3.0);
-    dy = round((slot1->dy + slot2->dy + slot3->dy) / 3.0);
-    if (dx != 0 || dy != 0) {
-        if (state->touchpad_state != TS_3_FINGER_DRAG) {
-            update_touchpad_state(state, TS_3_FINGER_DRAG, time);
-            xf86PostButtonEvent(pInfo->dev, FALSE, MOUSE_LEFT_BUTTON, TRUE, 0, 0);
-        }
-        xf86PostMotionEvent(pInfo->dev, 0, 0, 2, dx, dy);
+
+/* Reads the touches on the device now into pRandom->touches and returns
+ * how many there are, *current_slot_id is its ABS_MT_SLOT value. */
+static int
+random_read_touches(InputInfoPtr pInfo, int *current_slot_id)
+{
+    static const int codes[RANDOM_RESYNC_CODES] = {
+        ABS_MT_TRACKING_ID, ABS_MT_POSITION_X, ABS_MT_POSITION_Y
+    };
+    RandomDevicePtr pRandom = pInfo->private;
+    int num_slots = pRandom->state.num_slots;
+    int32_t *rows[RANDOM_RESYNC_CODES];
+    struct input_absinfo slot, pressure;
+    int have_mt = TRUE;
+    int count = 0, i;
+
+    for (i = 0; i < RANDOM_RESYNC_CODES && have_mt; i++) {
+        rows[i] = pRandom->mt_values + i * (num_slots + 1);
+        rows[i][0] = codes[i];
+        /* without MT state to go by, start over without touches */
+        if (ioctl(pInfo->fd, EVIOCGMTSLOTS((num_slots + 1) * sizeof(int32_t)), rows[i]) < 0)
+            have_mt = FALSE;
     }
+    if (ioctl(pInfo->fd, EVIOCGABS(ABS_MT_SLOT), &slot) < 0)
+        slot.value = -1;
+    /* the engine follows ABS_PRESSURE, not ABS_MT_PRESSURE, and a jump
+     * from another axis would look like a finger lifting */
+    if (ioctl(pInfo->fd, EVIOCGABS(ABS_PRESSURE), &pressure) < 0)
+        pressure.value = 0;
+
+    for (i = 0; have_mt && i < num_slots; i++) {
+        if (rows[0][i + 1] < 0)
+            continue;
+        pRandom->touches[count].slot_id = i;
+        pRandom->touches[count].x = rows[1][i + 1];
+        pRandom->touches[count].y = rows[2][i + 1];
+        pRandom->touches[count].pressure = pressure.value;
+        count++;
+    }
+    *current_slot_id = slot.value;
+    return count;
 }
-static CARD32 timerFunc(OsTimerPtr timer, CARD32 now, pointer arg) {
-    InputInfoPtr pInfo;
-    RandomDevicePtr pRandom;
-    struct State *state;
-    struct timeval time;
 
-    pInfo = arg;
-    pRandom = pInfo->private;
-    state = &pRandom->state;
-    if (state->touchpad_state == TS_3_FINGER_DRAG_RELEASING) {
-        time.tv_sec = 0;
-        time.tv_usec = 0;
-        update_touchpad_state_msg(state, TS_DEFAULT, &time, "Cancel 3 finger drag");
-        xf86PostButtonEvent(pInfo->dev, FALSE, MOUSE_LEFT_BUTTON, FALSE, 0, 0);
+/* Reads the touches back from the device after the kernel dropped events
+ * and hands them to the gesture engine, which drops the gesture in progress
+ * and continues from there. */
+static void
+random_resync(InputInfoPtr pInfo, struct timeval *time)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    int count, slot;
+
+    count = random_read_touches(pInfo, &slot);
+    gesture_resync(&pRandom->state, time, pRandom->touches, count, slot);
+    recorder_add_resync(&pRandom->recorder, pRandom->touches, count, slot);
+    xf86IDrvMsg(pInfo, X_WARNING, "kernel dropped events (%lu times so far), resynced %i touches\n",
+                pRandom->state.resyncs, count);
+}
+
+/* The recorder has no word for the device going off or on, it notes a
+ * resync to 'count' touches, which plays back the same. */
+static void
+random_record_restart(InputInfoPtr pInfo, struct timeval *time, int count, int current_slot_id)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct input_event ev;
+
+    ev.time = *time;
+    ev.type = EV_SYN;
+    ev.code = SYN_DROPPED;
+    ev.value = 0;
+    recorder_add(&pRandom->recorder, &ev);
+    recorder_add_resync(&pRandom->recorder, pRandom->touches, count, current_slot_id);
+    ev.code = SYN_REPORT;
+    recorder_add(&pRandom->recorder, &ev);
+}
+
+/* DEVICE_OFF, for a VT switch, a suspend or xinput disable: the gesture in
+ * progress ends now, with its buttons released, rather than carry on with
+ * stale touches and timeouts when the device comes back. */
+static void
+random_suspend(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct timeval now;
+
+    random_get_time(pInfo, &now);
+#ifdef HAVE_INPUT_THREAD
+    input_lock();
+#endif
+    gesture_suspend(&pRandom->state, &now);
+    random_record_restart(pInfo, &now, 0, -1);
+#ifdef HAVE_INPUT_THREAD
+    input_unlock();
+#endif
+}
+
+/* DEVICE_ON, with the new fd open: brings libevdev and the gesture engine
+ * to the touches on the device now, whatever happened while it was off. */
+static void
+random_resume(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct input_event ev;
+    struct timeval now;
+    int count, slot;
+
+    /* libevdev would go on from the state it had before */
+    if (!pRandom->bulk_read &&
+        libevdev_next_event(pRandom->evdev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &ev) == LIBEVDEV_READ_STATUS_SYNC) {
+        while (libevdev_next_event(pRandom->evdev, LIBEVDEV_READ_FLAG_SYNC, &ev) == LIBEVDEV_READ_STATUS_SYNC)
+            ;
     }
-    return 0;
+    count = random_read_touches(pInfo, &slot);
+    random_get_time(pInfo, &now);
+#ifdef HAVE_INPUT_THREAD
+    input_lock();
+#endif
+    gesture_resume(&pRandom->state, &now, pRandom->touches, count, slot);
+    random_record_restart(pInfo, &now, count, slot);
+#ifdef HAVE_INPUT_THREAD
+    input_unlock();
+#endif
+    if (count > 0)
+        xf86IDrvMsg(pInfo, X_INFO, "resumed with %i touches down\n", count);
 }
-static CARD32 timerfunc_scroll_momentum(OsTimerPtr timer, CARD32 now, pointer arg) {
-    InputInfoPtr pInfo;
-    RandomDevicePtr pRandom;
-    struct State *state;
-    struct timeval time;
 
-    pInfo = arg;
-    pRandom = pInfo->private;
-    state = &pRandom->state;
-    if (state->touchpad_state == TS_2_FINGER_SCROLL_MOMENTUM) {
-        time.tv_sec = 0;
-        time.tv_usec = 0;
-        do_scrolling(pInfo, state, &state->momentum_slot1, &state->momentum_slot2, &time, TRUE);
-        if ((fabs(state->momentum_slot1.delta_ddx) >= MOMENTUM_DELTA_LIMIT) || (fabs(state->momentum_slot1.delta_ddy) >= MOMENTUM_DELTA_LIMIT)) {
-            state->momentum_slot1.delta_ddx *= 0.97;
-            state->momentum_slot1.delta_ddy *= 0.97;
-            state->timer = TimerSet(state->timer, 0, 10, timerfunc_scroll_momentum, pInfo);
-        } else {
-            PRINT_DEBUG("Not enough momentum! delta_ddx: %f, delta_ddy: %f\n", state->momentum_slot1.delta_ddx, state->momentum_slot1.delta_ddy);
-            update_touchpad_state_msg(state, TS_DEFAULT, &time, "Scroll momentum is not enough");
-        }
+/* Opens the device node, or with a server managed fd takes the one the
+ * server passes in Option "fd". Returns the fd, -1 if there is none. */
+static int
+random_open_device(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+
+#ifdef HAVE_SERVER_FD
+    if (pInfo->flags & XI86_SERVER_FD) {
+        pInfo->fd = xf86CheckIntOption(pInfo->options, "fd", -1);
+        return pInfo->fd;
     }
-    return 0;
+#endif
+    SYSCALL(pInfo->fd = open(pRandom->device, O_RDONLY | O_NONBLOCK));
+    return pInfo->fd;
 }
-void process_EV_SYN(InputInfoPtr pInfo, struct State *state, struct timeval *time) {
-    int i;
-    struct Slot *slot, *slot1, *slot2, *slot3;
-    struct Slot *prev_slot, *prev_slot1, *prev_slot2, *prev_slot3;
-    if (state->touchpad_state == TS_3_FINGER_DRAG && state->active_slots != 3) {
-        update_touchpad_state(state, TS_3_FINGER_DRAG_RELEASING, time);
-        state->timer = TimerSet(state->timer, 0, 500, timerFunc, pInfo);
-    } else if (state->touchpad_state == TS_3_FINGER_DRAG_RELEASING) {
-        if (state->active_slots == 3) {
-            update_touchpad_state(state, TS_3_FINGER_DRAG, time);
-            TimerCancel(state->timer);
-        } else {
-            // keep waiting until timer kills the current state or the user reconnects the 3 fingers
-        }
-    } else if (state->touchpad_state == TS_2_FINGER_SCROLL && state->active_slots < 2) {
-        update_touchpad_state(state, TS_2_FINGER_SCROLL_RELEASING, time);
-        if (state->prev_active_slots == 2) {
-            get_2_active_slots(state->prev_slots, &prev_slot1, &prev_slot2);
-            if (fabs(prev_slot1->delta_ddx) >= MOMENTUM_DELTA_LIMIT_2X || fabs(prev_slot1->delta_ddy) >= MOMENTUM_DELTA_LIMIT_2X) {
-                state->momentum_slot1 = *prev_slot1;
-                state->momentum_slot2 = *prev_slot2;
-                if (fabs(state->momentum_slot1.delta_ddx) < MOMENTUM_DELTA_LIMIT_2X) {
-                    state->momentum_slot1.delta_ddx = 0;
-                    state->momentum_slot2.delta_ddx = 0;
-                }
-                if (fabs(state->momentum_slot1.delta_ddy) < MOMENTUM_DELTA_LIMIT_2X) {
-                    state->momentum_slot1.delta_ddy = 0;
-                    state->momentum_slot2.delta_ddy = 0;
-                }
-                update_touchpad_state(state, TS_2_FINGER_SCROLL_MOMENTUM, time);
-                PRINT_INFO("start scroll momentum delta_ddx: %f, delta_ddy: %f\n", state->momentum_slot1.delta_ddx, state->momentum_slot1.delta_ddy);
-                timerfunc_scroll_momentum(state->timer, 0, pInfo);
-            }
-        }
-    } else if (state->touchpad_state == TS_2_FINGER_SCROLL && state->active_slots > 2) {
-        update_touchpad_state_msg(state, TS_DEFAULT, time, "Cancel 2 finger scroll because more than 2 fingers touched");
-    } else if (state->touchpad_state == TS_2_FINGER_SCROLL_MOMENTUM) {
-        // momentum is emulated by timer, but user can stop it with 2 fingers
-        if (state->active_slots >= 2) {
-            update_touchpad_state_msg(state, TS_DEFAULT, time, "Cancel 2 finger scroll momentum with 2 or more fingers");
-            TimerCancel(state->timer);
-        } else if (state->active_slots == 1) {
-            i = get_active_slot_id(state->slots);
-            slot = &state->slots[i];
-            if (slot->elapsed_useconds >= 50000 && usec_diff(time, &state->touchpad_state_updated_at) > 50000) {
-                PRINT_DEBUG("Scroll momentum cancelled by holding 1 finger for %d msec\n", slot->elapsed_useconds / 1000);
-                update_touchpad_state_msg(state, TS_DEFAULT, time, "Cancel scroll momentum with 1 finger");
-                TimerCancel(state->timer);
-            }
-        }
-    } else if (state->active_slots == 1) {
-        i = get_active_slot_id(state->slots);
-        slot = &state->slots[i];
-        prev_slot = &state->prev_slots[i];
-
-        if (state->touchpad_state == TS_2_FINGER_SCROLL) {
-            // this should never happen, as this state is handled above
-        } else if (state->touchpad_state == TS_2_FINGER_SCROLL_RELEASING) {
-            if (usec_diff(time, &state->touchpad_state_updated_at) < 100000) {
-                // keep waiting
-            } else {
-                update_touchpad_state_msg(state, TS_DEFAULT, time, "Switching to normal mouse moving");
-                // overwrite the start position
-                slot->startx = slot->x;
-                slot->starty = slot->y;
-            }
-        } else {
-            set_start_fields_if_not_set(slot, time);
-            calculate_dx_dy(slot, prev_slot, time);
-            if (slot->dx != 0 || slot->dy != 0) {
-                xf86PostMotionEvent(pInfo->dev, 0, 0, 2, slot->dx, slot->dy);
-            }
-        }
-    } else if (state->active_slots == 0 && state->prev_active_slots == 1) {
-        i = get_active_slot_id(state->prev_slots);
-        if (state->touchpad_state == TS_2_FINGER_SCROLL_RELEASING) {
-            update_touchpad_state_msg(state, TS_DEFAULT, time, "No more fingers touching");
-        }
-        if (i >= 0) {
-            prev_slot = &state->prev_slots[i];
-            if (is_tap_click(prev_slot)) {
-                PRINT_INFO("Tap to click\n");
-                xf86PostButtonEvent(pInfo->dev, FALSE, MOUSE_LEFT_BUTTON, TRUE, 0, 0);
-                xf86PostButtonEvent(pInfo->dev, FALSE, MOUSE_LEFT_BUTTON, FALSE, 0, 0);
-            }
-        } else {
-            PRINT_WARN("No active prev_slot! slots: (%s %i:%i %umsec) (%s %i:%i %umsec) (%s %i:%i %umsec) (%s %i:%i %umsec) (%s %i:%i %umsec)\n",
-                state->prev_slots[0].active ? "*" : "-", state->prev_slots[0].x, state->prev_slots[0].y, state->prev_slots[0].elapsed_useconds/1000,
-                state->prev_slots[1].active ? "*" : "-", state->prev_slots[1].x, state->prev_slots[1].y, state->prev_slots[1].elapsed_useconds/1000,
-                state->prev_slots[2].active ? "*" : "-", state->prev_slots[2].x, state->prev_slots[2].y, state->prev_slots[2].elapsed_useconds/1000,
-                state->prev_slots[3].active ? "*" : "-", state->prev_slots[3].x, state->prev_slots[3].y, state->prev_slots[3].elapsed_useconds/1000,
-                state->prev_slots[4].active ? "*" : "-", state->prev_slots[4].x, state->prev_slots[4].y, state->prev_slots[4].elapsed_useconds/1000
-                );
-        }
-    } else if (state->active_slots == 2 && state->prev_active_slots == 2) {
-        get_2_active_slots(state->slots, &slot1, &slot2);
-        if (slot1 != NULL && slot2 != NULL) {
-            get_2_active_slots(state->prev_slots, &prev_slot1, &prev_slot2);
-            if (prev_slot1 != NULL && prev_slot2 != NULL) {
-                handle_2_finger_scroll(pInfo, state, slot1, slot2, prev_slot1, prev_slot2, time);
-            }
-        }
-    } else if (state->active_slots == 3 && state->prev_active_slots == 3) {
-        get_3_active_slots(state->slots, &slot1, &slot2, &slot3);
-        if (slot1 != NULL && slot2 != NULL && slot3 != NULL) {
-            get_3_active_slots(state->prev_slots, &prev_slot1, &prev_slot2, &prev_slot3);
-            if (prev_slot1 != NULL && prev_slot2 != NULL && prev_slot3 != NULL) {
-                handle_3_finger_drag(pInfo, state, slot1, slot2, slot3, prev_slot1, prev_slot2, prev_slot3, time);
-            }
-        }
-    } else {
-        PRINT_INFO("Unhandled case in process_EV_SYN! touchpad_state: %i, active_slots: %i, prev_active_slots: %i\n",
-            state->touchpad_state, state->active_slots, state->prev_active_slots);
-        if (state->touchpad_state != TS_DEFAULT && usec_diff(time, &state->touchpad_state_updated_at) > 3000000) {
-            PRINT_INFO("State was stuck to %i, resetting it to TS_DEFAULT.\n", state->touchpad_state);
-            update_touchpad_state_msg(state, TS_DEFAULT, time, "Unlock stucked state");
-        }
+
+/* Closes what random_open_device() opened, a server managed fd stays open
+ * for the server to close. */
+static void
+random_close_device(InputInfoPtr pInfo)
+{
+#ifdef HAVE_SERVER_FD
+    if (pInfo->flags & XI86_SERVER_FD) {
+        pInfo->fd = -1;
+        return;
     }
+#endif
+    if (pInfo->fd >= 0)
+        close(pInfo->fd);
+    pInfo->fd = -1;
 }
-void save_current_values_to_prev(struct State *state) {
-    int i;
-    state->prev_active_slots = state->active_slots;
-    for (i = 0; i < MAX_SLOTS; ++i) {
-        state->prev_slots[i] = state->slots[i];
-    }
-}
-void process_event(InputInfoPtr pInfo, struct State *state, struct timeval *time, int type, int code, int value) {
-    switch (type) {
-        case EV_SYN:
-        calculate_elapsed_useconds_and_active_slots(state, time);
-        debug_slots(state);
-        process_EV_SYN(pInfo, state, time);
-        save_current_values_to_prev(state);
-        break;
-        case EV_KEY:
-        switch (code) {
-            case BTN_LEFT:
-            if (state->active_slots == 1) {
-                xf86PostButtonEvent(pInfo->dev, FALSE, MOUSE_LEFT_BUTTON, value, 0, 0);
-            } else if (state->active_slots == 2) {
-                xf86PostButtonEvent(pInfo->dev, FALSE, MOUSE_RIGHT_BUTTON, value, 0, 0);
-            }
-            break;
-            case BTN_TOOL_FINGER:
-            break;
-            case BTN_TOOL_QUINTTAP:
-            break;
-            case BTN_TOUCH:
-            break;
-            case BTN_TOOL_DOUBLETAP:
-            break;
-            case BTN_TOOL_TRIPLETAP:
-            break;
-            case BTN_TOOL_QUADTAP:
+
+/* Reads the events with one read() per buffer and hands every complete
+ * frame to the gesture engine where it lies in the buffer. What is left of
+ * an incomplete frame is moved to the front and finished by the next read.
+ * After a SYN_DROPPED the touches are read back from the device and the
+ * rest of the frame is discarded, as the evdev protocol asks for. */
+static void
+random_read_frames(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+    struct input_event *events = pRandom->events;
+    ssize_t len;
+    int count, start, i;
+
+    while (1) {
+        len = read(pInfo->fd, events + pRandom->num_events,
+                   (RANDOM_READ_EVENTS - pRandom->num_events) * sizeof(struct input_event));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                xf86Msg(X_ERROR, "%s: cannot read events: %s\n", pInfo->name, strerror(errno));
             break;
         }
-        break;
-        case EV_ABS:
-        switch (code) {
-            case ABS_X:
-            break;
-            case ABS_Y:
-            break;
-            case ABS_PRESSURE:
-            state->slots[state->current_slot_id].pressure = value;
-            break;
-            case ABS_TOOL_WIDTH:
-            break;
-            case ABS_MT_SLOT:
-            set_start_fields_if_not_set(&state->slots[state->current_slot_id], time);
-            state->current_slot_id = value;
-            activate_current_slot(state, time);
-            break;
-            case ABS_MT_TOUCH_MAJOR:
-            state->slots[state->current_slot_id].touch_major = value;
-            break;
-            case ABS_MT_TOUCH_MINOR:
-            state->slots[state->current_slot_id].touch_minor = value;
-            break;
-            case ABS_MT_WIDTH_MAJOR:
-            state->slots[state->current_slot_id].width_major = value;
-            break;
-            case ABS_MT_WIDTH_MINOR:
-            state->slots[state->current_slot_id].width_minor = value;
+        if (len == 0)
             break;
-            case ABS_MT_ORIENTATION:
-            state->slots[state->current_slot_id].orientation = value;
-            break;
-            case ABS_MT_POSITION_X:
-            state->slots[state->current_slot_id].x = value;
-            break;
-            case ABS_MT_POSITION_Y:
-            state->slots[state->current_slot_id].y = value;
-            break;
-            case ABS_MT_TRACKING_ID:
-            if (value < 0) {
-                clear_slot(&state->slots[state->current_slot_id]);
-            } else {
-                activate_current_slot(state, time);
+
+        count = pRandom->num_events + len / sizeof(struct input_event);
+        start = 0;
+        for (i = pRandom->num_events; i < count; i++) {
+            recorder_add(&pRandom->recorder, &events[i]);
+            if (events[i].type != EV_SYN)
+                continue;
+            if (events[i].code == SYN_DROPPED) {
+                random_resync(pInfo, &events[i].time);
+                pRandom->skip_frame = TRUE;
+                start = i + 1;
+            } else if (events[i].code == SYN_REPORT) {
+                if (!pRandom->skip_frame)
+                    process_frame(&pRandom->state, events + start, i + 1 - start);
+                pRandom->skip_frame = FALSE;
+                start = i + 1;
             }
-            break;
         }
-        break;
-    }
-    if (type != EV_SYN) {
-        PRINT_DEBUG("data: %zu %8zu %6i %s\n", time->tv_sec, time->tv_usec, value, type_and_code_name(type, code));
+
+        if (pRandom->skip_frame) {
+            pRandom->num_events = 0;
+        } else if (start == 0 && count == RANDOM_READ_EVENTS) {
+            /* a frame bigger than the buffer, pass on what we have */
+            process_frame(&pRandom->state, events, count);
+            pRandom->num_events = 0;
+        } else {
+            pRandom->num_events = count - start;
+            memmove(events, events + start, pRandom->num_events * sizeof(struct input_event));
+        }
     }
 }
 
 static void RandomReadInput(InputInfoPtr pInfo)
+{
+    RandomDevicePtr pRandom = pInfo->private;
+
+    /* after a stall, post the motion of all waiting frames at once */
+    if (pRandom->coalesce)
+        gesture_coalesce_begin(&pRandom->state);
+
+    if (pRandom->bulk_read) {
+        random_read_frames(pInfo);
+    } else {
+        random_next_events(pInfo);
+    }
+
+    if (pRandom->coalesce)
+        gesture_coalesce_end(&pRandom->state);
+}
+
+/* The per-event path through libevdev, see Option "BulkRead". */
+static void
+random_next_events(InputInfoPtr pInfo)
 {
     RandomDevicePtr pRandom = pInfo->private;
     struct input_event ev;
+    struct timeval time;
     int res;
 
     while (1) {
@@ -997,8 +1263,15 @@ static void RandomReadInput(InputInfoPtr pInfo)
                 xf86Msg(X_ERROR, "Cannot read next event: %i\n", res);
                 break;
             }
+        } else if (res == LIBEVDEV_READ_STATUS_SYNC) {
+            recorder_add(&pRandom->recorder, &ev);
+            time = ev.time;
+            while (libevdev_next_event(pRandom->evdev, LIBEVDEV_READ_FLAG_SYNC, &ev) == LIBEVDEV_READ_STATUS_SYNC)
+                ;
+            random_resync(pInfo, &time);
         } else {
-            process_event(pInfo, &pRandom->state, &ev.time, ev.type, ev.code, ev.value);
+            recorder_add(&pRandom->recorder, &ev);
+            process_event(&pRandom->state, &ev.time, ev.type, ev.code, ev.value);
         }
     }
 }
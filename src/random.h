@@ -1,6 +1,6 @@
 /*
  * Copyright 2007 Peter Hutterer
- * Copyright 2009 Przemysaw Firszt
+ * Copyright 2009 PrzemysÃÂ¿aw Firszt
  *
  * Permission to use, copy, modify, distribute, and sell this software
  * and its documentation for any purpose is hereby granted without
@@ -24,76 +24,52 @@
 
 #define SYSCALL(call) while (((call) == -1) && (errno == EINTR))
 
-#ifdef DEBUG
-#define PRINT_WARN(...)  xf86Msg(X_WARNING, __VA_ARGS__)
-#define PRINT_INFO(...)  xf86Msg(X_INFO,    __VA_ARGS__)
-#define PRINT_DEBUG(...) xf86Msg(X_DEBUG,   __VA_ARGS__)
-#else
-#define PRINT_WARN(...)
-#define PRINT_INFO(...)
-#define PRINT_DEBUG(...)
-#endif
+/* size of the read() buffer of the bulk read path, in events */
+#define RANDOM_READ_EVENTS 256
 
-#define MOUSE_LEFT_BUTTON               1
-#define MOUSE_RIGHT_BUTTON              3
-#define MOUSE_MIDDLE_BUTTON             2
-#define MOUSE_VERTICAL_WHEEL_1_BUTTON   4
-#define MOUSE_VERTICAL_WHEEL_2_BUTTON   5
-#define MOUSE_HORIZONTAL_WHEEL_1_BUTTON 6
-#define MOUSE_HORIZONTAL_WHEEL_2_BUTTON 7
-
-#define MOMENTUM_DELTA_LIMIT 0.2f
-#define MOMENTUM_DELTA_LIMIT_2X (2 * MOMENTUM_DELTA_LIMIT)
-
-#define MAX_SLOTS 100
-
-enum TouchpadStates {
-    TS_DEFAULT,
-    TS_2_FINGER_SCROLL, // there are 2 active slots
-    TS_2_FINGER_SCROLL_RELEASING, // previously there were 2 active slots but now only 1. Ignoring pointer movements for a short period to avoid accidental pointer movements after scrolling with 2 fingers
-    TS_2_FINGER_SCROLL_MOMENTUM,
-    TS_3_FINGER_DRAG,
-    TS_3_FINGER_DRAG_RELEASING,
-};
+#define RANDOM_LONG_BITS (8 * sizeof(unsigned long))
+#define RANDOM_NLONGS(bits) (((bits) + RANDOM_LONG_BITS - 1) / RANDOM_LONG_BITS)
+
+/* valuators: relative motion on 0 and 1, then the scroll axes */
+#define RANDOM_AXIS_HSCROLL 2
+#define RANDOM_AXIS_VSCROLL 3
+
+/* scroll axis distance of one wheel click */
+#define RANDOM_SCROLL_INCREMENT 1.0
+
+/* MT codes read back after a SYN_DROPPED: tracking id, x and y */
+#define RANDOM_RESYNC_CODES 3
+
+/* event types of the kernel event mask: EV_KEY, EV_ABS and EV_MSC */
+#define RANDOM_MASK_TYPES 3
+
+/* commands waiting for the input thread, see random_push_command() */
+#define RANDOM_COMMANDS 16
+
+/* the default StatsFile is this and the name of the device node */
+#define RANDOM_STATS_PREFIX "/dev/shm/random-stats-"
+
+/* the gesture thresholds, see random_tunables[] */
+#define RANDOM_TUNABLES 12
+
+/* the default TraceFile is this and the name of the device node */
+#define RANDOM_TRACE_PREFIX "/var/tmp/random-trace-"
 
-struct Slot {
-    int slot_id;
-    int active;
-    int x;
-    int y;
-    int pressure;
-    int touch_major;
-    int touch_minor;
-    int width_major;
-    int width_minor;
-    int orientation;
-
-    struct timeval start_time;
-    int elapsed_useconds;
-
-    int startx;
-    int starty;
-
-    double ddx;
-    double ddy;
-    double delta_ddx;
-    double delta_ddy;
-    int dx;
-    int dy;
-    int total_dx; // total horizontal movement since the slot is active
-    int total_dy; // total vertical movement since the slot is active
+/* the default RecorderFile is this, the name of the device node and .events */
+#define RANDOM_RECORDER_PREFIX "/var/tmp/random-recording-"
+
+/* defaults of Option "RecorderSize" in KiB and "RecorderSeconds" */
+#define RANDOM_RECORDER_SIZE 256
+#define RANDOM_RECORDER_SECONDS 60
+
+/* work the main thread hands to the input thread, see random_queue_command() */
+enum RandomCommandType {
+    RANDOM_CMD_CONFIG,  /* a property changed, pass 'config' to gesture_set_config() */
 };
-struct State {
-    struct Slot slots[MAX_SLOTS];
-    struct Slot prev_slots[MAX_SLOTS];
-    int current_slot_id;
-    int active_slots;
-    int prev_active_slots;
-    enum TouchpadStates touchpad_state;
-    struct timeval touchpad_state_updated_at;
-    OsTimerPtr timer;
-    struct Slot momentum_slot1;
-    struct Slot momentum_slot2;
+
+struct RandomCommand {
+    enum RandomCommandType type;
+    struct GestureConfig config;
 };
 
 typedef struct _RandomDeviceRec
@@ -104,7 +80,43 @@ typedef struct _RandomDeviceRec
     int num_vals;
     int axes;
     struct libevdev* evdev;
+    OsTimerPtr timer;
     struct State state;
+    Bool bulk_read;     /* read() the fd directly instead of libevdev_next_event */
+    Bool coalesce;      /* merge the motion of all frames of one read */
+    Bool monotonic;     /* event timestamps are CLOCK_MONOTONIC */
+    Bool skip_frame;    /* dropping events until the SYN_REPORT after a SYN_DROPPED */
+    int num_events;     /* events of an incomplete frame at the start of 'events' */
+    struct input_event events[RANDOM_READ_EVENTS];
+    int32_t *mt_values; /* EVIOCGMTSLOTS buffers, RANDOM_RESYNC_CODES rows of 1 + num_slots */
+    unsigned long event_codes[RANDOM_MASK_TYPES][RANDOM_NLONGS(KEY_CNT)]; /* see random_init_event_mask() */
+    struct GestureTouch *touches;
+    struct GestureConfig config; /* as the options and properties set it, main thread */
+    char *stats_path;   /* Option "StatsFile" */
+    struct GestureStats *stats; /* mapped stats_path, NULL if off */
+    char *trace_path;   /* Option "TraceFile" */
+    struct Recorder recorder; /* the raw events read, off with RecorderSize 0 */
+    char *recorder_path; /* Option "RecorderFile" */
+#ifdef HAVE_DEVICE_PROPERTIES
+    Atom tunable_atoms[RANDOM_TUNABLES];
+    Atom float_type;
+    Atom trace_level_atom;
+    Atom trace_dump_atom;
+    Atom recorder_snapshot_atom;
+#endif
+#ifdef HAVE_INPUT_THREAD
+    int wake_fd;        /* eventfd that runs random_read_commands(), -1 while off */
+    int timer_pending;  /* the timer expired, see random_timer_func() */
+    struct RandomCommand commands[RANDOM_COMMANDS];
+    unsigned int command_head; /* next command to write, main thread only */
+    unsigned int command_tail; /* next command to read, input thread only */
+#endif
+#ifdef HAVE_SMOOTH_SCROLLING
+    ValuatorMask *scroll_mask;
+#else
+    double scroll_dx;   /* scroll fractions not posted as a click yet */
+    double scroll_dy;
+#endif
 } RandomDeviceRec, *RandomDevicePtr ;
 
 static int RandomPreInit(InputDriverPtr  drv, InputInfoPtr pInfo, int flags);
@@ -112,29 +124,39 @@ static void RandomUnInit(InputDriverPtr drv, InputInfoPtr pInfo, int flags);
 static pointer RandomPlug(pointer module, pointer options, int *errmaj, int  *errmin);
 static void RandomUnplug(pointer p);
 static void RandomReadInput(InputInfoPtr pInfo);
+static void random_read_frames(InputInfoPtr pInfo);
+static void random_next_events(InputInfoPtr pInfo);
+static void random_resync(InputInfoPtr pInfo, struct timeval *time);
+static int random_read_touches(InputInfoPtr pInfo, int *current_slot_id);
+static void random_record_restart(InputInfoPtr pInfo, struct timeval *time, int count, int current_slot_id);
+static void random_suspend(InputInfoPtr pInfo);
+static void random_resume(InputInfoPtr pInfo);
+static int random_open_device(InputInfoPtr pInfo);
+static void random_close_device(InputInfoPtr pInfo);
+static void random_init_event_mask(InputInfoPtr pInfo);
+static void random_update_event_mask(InputInfoPtr pInfo);
+static void random_dump_trace(InputInfoPtr pInfo);
+static void random_snapshot_recorder(InputInfoPtr pInfo);
+#ifdef HAVE_DEVICE_PROPERTIES
+static void random_run_command(InputInfoPtr pInfo, const struct RandomCommand *command);
+static void random_queue_command(InputInfoPtr pInfo, const struct RandomCommand *command);
+static Atom random_init_int_property(DeviceIntPtr device, const char *name, INT32 value);
+static void random_init_properties(DeviceIntPtr device);
+static int random_set_property(DeviceIntPtr device, Atom atom, XIPropertyValuePtr val, BOOL checkonly);
+#endif
+#ifdef HAVE_INPUT_THREAD
+static Bool random_push_command(RandomDevicePtr pRandom, const struct RandomCommand *command);
+static Bool random_pop_command(RandomDevicePtr pRandom, struct RandomCommand *command);
+static void random_read_commands(int fd, int ready, void *data);
+static void random_drain_commands(InputInfoPtr pInfo);
+#endif
 static int RandomControl(DeviceIntPtr    device,int what);
 static int _random_init_buttons(DeviceIntPtr device);
 static int _random_init_axes(DeviceIntPtr device);
 
-const char *type_and_code_name(int type, int code);
-const char *touchpad_state_name(enum TouchpadStates state);
-time_t usec_diff(struct timeval *end, struct timeval *start);
-void calculate_elapsed_useconds_and_active_slots(struct State *state, struct timeval *time);
-void clear_state(struct State *state);
-void clear_slot(struct Slot *slot);
-void activate_current_slot(struct State *state, struct timeval *time);
-int get_active_slot_id(struct Slot slots[]);
-void get_2_active_slots(struct Slot slots[], struct Slot **slot1, struct Slot **slot2);
-void get_3_active_slots(struct Slot slots[], struct Slot **slot1, struct Slot **slot2, struct Slot **slot3);
-int is_tap_click(struct Slot *slot);
-void set_start_fields_if_not_set(struct Slot *slot, struct timeval *time);
-void calculate_dx_dy(struct Slot *slot, struct Slot *prev_slot, struct timeval *time);
-void update_touchpad_state(struct State *state, enum TouchpadStates new_state, struct timeval *time);
-void update_touchpad_state_msg(struct State *state, enum TouchpadStates new_state, struct timeval *time, const char *msg);
-void debug_slots(struct State *state);
-void do_scrolling(InputInfoPtr pInfo, struct State *state, struct Slot *slot1, struct Slot *slot2, struct timeval *time, int is_momentum);
-void handle_2_finger_scroll(InputInfoPtr pInfo, struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *prev_slot1, struct Slot *prev_slot2, struct timeval *time);
-void handle_3_finger_drag(InputInfoPtr pInfo, struct State *state, struct Slot *slot1, struct Slot *slot2, struct Slot *slot3, struct Slot *prev_slot1, struct Slot *prev_slot2, struct Slot *prev_slot3, struct timeval *time);
-void process_EV_SYN(InputInfoPtr pInfo, struct State *state, struct timeval *time);
-void save_current_values_to_prev(struct State *state);
-void process_event(InputInfoPtr pInfo, struct State *state, struct timeval *time, int type, int code, int value);
+static void random_post_motion(void *data, int dx, int dy);
+static void random_post_button(void *data, int button, int is_press);
+static void random_post_scroll(void *data, double dx, double dy);
+static void random_get_time(void *data, struct timeval *time);
+static void random_set_timer(void *data, int millis);
+static void random_cancel_timer(void *data);
@@ -0,0 +1,495 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include <linux/input.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gesture.h"
+#include "recorder.h"
+
+// op byte: the time follows, the value follows, the index of the code
+#define OP_TIME 0x80
+#define OP_VALUE 0x40
+#define OP_INDEX 0x3f
+// indexes that are not a code: any other event, with its type and code
+// after the time, and the markers of a keyframe and a resync
+#define OP_OTHER 60
+#define OP_KEYFRAME 61
+#define OP_KEYFRAME_END 62
+#define OP_RESYNC 63
+
+// room for the longest event (op, time, type, code and value) and the
+// start of a resync after it
+#define MAX_EVENT_SIZE 40
+// the start of a resync: op, slot and count
+#define RESYNC_SIZE 11
+// a touch of a resync: slot, x, y and pressure
+#define MAX_TOUCH_SIZE 20
+// a block ends after the frame that gets it this close to full
+#define BLOCK_SLACK 256
+
+// the table the op byte refers to; ABS_MT_SLOT and the MT codes are last
+#define FIRST_KEY 3
+#define FIRST_MT 14
+#define FIRST_TOUCH (FIRST_MT + 1)
+static const struct {
+    uint16_t type;
+    uint16_t code;
+} codes[RECORDER_CODES] = {
+    { EV_SYN, SYN_REPORT },
+    { EV_SYN, SYN_DROPPED },
+    { EV_MSC, MSC_TIMESTAMP },
+    { EV_KEY, BTN_LEFT },
+    { EV_KEY, BTN_TOUCH },
+    { EV_KEY, BTN_TOOL_FINGER },
+    { EV_KEY, BTN_TOOL_DOUBLETAP },
+    { EV_KEY, BTN_TOOL_TRIPLETAP },
+    { EV_KEY, BTN_TOOL_QUADTAP },
+    { EV_KEY, BTN_TOOL_QUINTTAP },
+    { EV_ABS, ABS_X },
+    { EV_ABS, ABS_Y },
+    { EV_ABS, ABS_PRESSURE },
+    { EV_ABS, ABS_TOOL_WIDTH },
+    { EV_ABS, ABS_MT_SLOT },
+    { EV_ABS, ABS_MT_TOUCH_MAJOR },
+    { EV_ABS, ABS_MT_TOUCH_MINOR },
+    { EV_ABS, ABS_MT_WIDTH_MAJOR },
+    { EV_ABS, ABS_MT_WIDTH_MINOR },
+    { EV_ABS, ABS_MT_ORIENTATION },
+    { EV_ABS, ABS_MT_POSITION_X },
+    { EV_ABS, ABS_MT_POSITION_Y },
+    { EV_ABS, ABS_MT_TOOL_TYPE },
+    { EV_ABS, ABS_MT_BLOB_ID },
+    { EV_ABS, ABS_MT_TRACKING_ID },
+    { EV_ABS, ABS_MT_PRESSURE },
+    { EV_ABS, ABS_MT_DISTANCE },
+};
+
+// the column of an MT code in the rows of touches
+#define COLUMN(code) ((code) - ABS_MT_TOUCH_MAJOR)
+
+static int code_index(unsigned int type, unsigned int code) {
+    int i;
+
+    switch (type) {
+        case EV_SYN:
+        return code == SYN_REPORT ? 0 : code == SYN_DROPPED ? 1 : -1;
+        case EV_MSC:
+        return code == MSC_TIMESTAMP ? 2 : -1;
+        case EV_ABS:
+        if (code >= ABS_MT_SLOT && code <= ABS_MT_DISTANCE) {
+            return FIRST_MT + code - ABS_MT_SLOT;
+        }
+        // fall through
+        case EV_KEY:
+        for (i = FIRST_KEY; i < FIRST_MT; ++i) {
+            if (codes[i].type == type && codes[i].code == code) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static int slot_row(int slot, int num_slots) {
+    return slot >= 0 && slot < num_slots ? slot : num_slots;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static unsigned char *put_varint(unsigned char *p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+/* NULL when the varint runs past 'end'. */
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *value) {
+    int shift = 0;
+
+    *value = 0;
+    while (p < end && shift < 64) {
+        *value |= (uint64_t) (*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+static struct RecorderBlock *last_block(struct Recorder *recorder) {
+    return &recorder->blocks[(recorder->first + recorder->count - 1) % recorder->num_blocks];
+}
+static unsigned char *block_data(const struct Recorder *recorder, const struct RecorderBlock *block) {
+    return recorder->data + (block - recorder->blocks) * RECORDER_BLOCK_SIZE;
+}
+
+/* Appends one event to the last block, which has room for it. */
+static void encode(struct Recorder *recorder, int index, uint64_t time, int type, int code, int32_t value) {
+    struct RecorderBlock *block = last_block(recorder);
+    unsigned char *start = block_data(recorder, block) + block->used;
+    unsigned char *p = start + 1;
+    int32_t *base = NULL;
+    int op;
+
+    if (index < 0) {
+        op = OP_OTHER | OP_VALUE;
+    } else if (index >= FIRST_TOUCH) {
+        base = &recorder->touch_bases[slot_row(recorder->slot, recorder->num_slots) * RECORDER_MT_CODES + index - FIRST_TOUCH];
+        op = index;
+    } else {
+        base = &recorder->bases[index];
+        op = index;
+    }
+    if (time != recorder->time) {
+        op |= OP_TIME;
+        p = put_varint(p, zigzag((int32_t) (time - recorder->time)));
+        recorder->time = time;
+    }
+    if (index < 0) {
+        p = put_varint(p, type);
+        p = put_varint(p, code);
+        p = put_varint(p, zigzag(value));
+    } else if (value != *base) {
+        op |= OP_VALUE;
+        p = put_varint(p, zigzag((int32_t) ((uint32_t) value - (uint32_t) *base)));
+        *base = value;
+    }
+    *start = op;
+    block->used = p - block_data(recorder, block);
+    block->end = time;
+    if (index == FIRST_MT) {
+        recorder->slot = value;
+    }
+}
+
+/* The time deltas are 32 bit, a longer pause, or one of more than max_age,
+ * starts a new block from the absolute time. */
+static int delta_fits(const struct Recorder *recorder, uint64_t time) {
+    int64_t delta = (int64_t) (time - recorder->time);
+
+    if (delta < INT32_MIN || delta > INT32_MAX) {
+        return 0;
+    }
+    return recorder->max_age == 0 || delta <= (int64_t) recorder->max_age;
+}
+
+static void put_op(struct Recorder *recorder, int op) {
+    struct RecorderBlock *block = last_block(recorder);
+
+    block_data(recorder, block)[block->used++] = op;
+}
+
+/* Starts a new block at 'time', dropping the oldest one if there is no
+ * free block, and puts the keys and touches that are down into it. */
+static void start_block(struct Recorder *recorder, uint64_t time) {
+    struct RecorderBlock *block;
+    int32_t *touch;
+    int slot = recorder->slot;
+    int i, s;
+
+    if (recorder->count == recorder->num_blocks) {
+        recorder->first = (recorder->first + 1) % recorder->num_blocks;
+        recorder->count--;
+    }
+    recorder->count++;
+    recorder->full = 0;
+    block = last_block(recorder);
+    block->start = block->end = time;
+    block->used = 0;
+    recorder->time = time;
+    memset(recorder->bases, 0, sizeof(recorder->bases));
+    memset(recorder->touch_bases, 0, (recorder->num_slots + 1) * RECORDER_MT_CODES * sizeof(int32_t));
+
+    put_op(recorder, OP_KEYFRAME);
+    for (i = FIRST_KEY; i < FIRST_MT; ++i) {
+        if (recorder->values[i]) {
+            encode(recorder, i, time, codes[i].type, codes[i].code, recorder->values[i]);
+        }
+    }
+    for (s = 0; s < recorder->num_slots && block->used < RECORDER_BLOCK_SIZE / 2; ++s) {
+        touch = &recorder->touches[s * RECORDER_MT_CODES];
+        if (touch[COLUMN(ABS_MT_TRACKING_ID)] < 0) {
+            continue;
+        }
+        // in the order of the kernel, the tracking id first
+        encode(recorder, FIRST_MT, time, EV_ABS, ABS_MT_SLOT, s);
+        encode(recorder, FIRST_TOUCH + COLUMN(ABS_MT_TRACKING_ID), time, EV_ABS, ABS_MT_TRACKING_ID,
+               touch[COLUMN(ABS_MT_TRACKING_ID)]);
+        for (i = FIRST_TOUCH; i < RECORDER_CODES; ++i) {
+            if (touch[i - FIRST_TOUCH] && codes[i].code != ABS_MT_TRACKING_ID) {
+                encode(recorder, i, time, EV_ABS, codes[i].code, touch[i - FIRST_TOUCH]);
+            }
+        }
+    }
+    // the slot starts at 0 in a block, like on a new device
+    if (block->used > 1 || slot != 0) {
+        encode(recorder, FIRST_MT, time, EV_ABS, ABS_MT_SLOT, slot);
+    }
+    put_op(recorder, OP_KEYFRAME_END);
+}
+
+/* 'size' bytes of events, at least two blocks, written out only if they are
+ * at most 'seconds' old. -1 if there is no memory for it. */
+int recorder_init(struct Recorder *recorder, int num_slots, size_t size, int seconds) {
+    int s;
+
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->num_blocks = (size + RECORDER_BLOCK_SIZE - 1) / RECORDER_BLOCK_SIZE;
+    if (recorder->num_blocks < 2) {
+        recorder->num_blocks = 2;
+    }
+    recorder->num_slots = num_slots;
+    recorder->max_age = seconds * 1000000ULL;
+    recorder->data = malloc((size_t) recorder->num_blocks * RECORDER_BLOCK_SIZE);
+    recorder->blocks = calloc(recorder->num_blocks, sizeof(struct RecorderBlock));
+    recorder->touches = calloc((num_slots + 1) * RECORDER_MT_CODES, sizeof(int32_t));
+    recorder->touch_bases = calloc((num_slots + 1) * RECORDER_MT_CODES, sizeof(int32_t));
+    if (!recorder->data || !recorder->blocks || !recorder->touches || !recorder->touch_bases) {
+        recorder_free(recorder);
+        return -1;
+    }
+    for (s = 0; s <= num_slots; ++s) {
+        recorder->touches[s * RECORDER_MT_CODES + COLUMN(ABS_MT_TRACKING_ID)] = -1;
+    }
+    return 0;
+}
+void recorder_free(struct Recorder *recorder) {
+    free(recorder->data);
+    free(recorder->blocks);
+    free(recorder->touches);
+    free(recorder->touch_bases);
+    memset(recorder, 0, sizeof(*recorder));
+}
+/* A snapshot of the events to write out while more come in, free it with
+ * recorder_free(). -1 if there is no memory for it. */
+int recorder_copy(struct Recorder *copy, const struct Recorder *recorder) {
+    size_t touches = (recorder->num_slots + 1) * RECORDER_MT_CODES * sizeof(int32_t);
+
+    *copy = *recorder;
+    copy->data = NULL;
+    copy->blocks = NULL;
+    copy->touches = NULL;
+    copy->touch_bases = NULL;
+    if (!recorder->data) {
+        return 0;
+    }
+    copy->data = malloc((size_t) recorder->num_blocks * RECORDER_BLOCK_SIZE);
+    copy->blocks = malloc(recorder->num_blocks * sizeof(struct RecorderBlock));
+    copy->touches = malloc(touches);
+    copy->touch_bases = malloc(touches);
+    if (!copy->data || !copy->blocks || !copy->touches || !copy->touch_bases) {
+        recorder_free(copy);
+        return -1;
+    }
+    memcpy(copy->data, recorder->data, (size_t) recorder->num_blocks * RECORDER_BLOCK_SIZE);
+    memcpy(copy->blocks, recorder->blocks, recorder->num_blocks * sizeof(struct RecorderBlock));
+    memcpy(copy->touches, recorder->touches, touches);
+    memcpy(copy->touch_bases, recorder->touch_bases, touches);
+    return 0;
+}
+
+void recorder_add(struct Recorder *recorder, const struct input_event *ev) {
+    uint64_t time;
+    int index;
+
+    if (!recorder->data) {
+        return;
+    }
+    time = ev->time.tv_sec * 1000000ULL + ev->time.tv_usec;
+    if (recorder->count == 0 || recorder->full ||
+        last_block(recorder)->used > RECORDER_BLOCK_SIZE - MAX_EVENT_SIZE || !delta_fits(recorder, time)) {
+        start_block(recorder, time);
+    }
+    index = code_index(ev->type, ev->code);
+    encode(recorder, index, time, ev->type, ev->code, ev->value);
+    if (index >= FIRST_TOUCH) {
+        recorder->touches[slot_row(recorder->slot, recorder->num_slots) * RECORDER_MT_CODES + index - FIRST_TOUCH] = ev->value;
+    } else if (index >= 0) {
+        recorder->values[index] = ev->value;
+    }
+    // keyframes go between frames, unless a frame does not fit in a block
+    if (index == 0 && last_block(recorder)->used > RECORDER_BLOCK_SIZE - BLOCK_SLACK) {
+        recorder->full = 1;
+    }
+}
+
+/* Records the touches the driver read back after a SYN_DROPPED, right
+ * after that event; they replace all touches. */
+void recorder_add_resync(struct Recorder *recorder, const struct GestureTouch *touches, int count, int current_slot_id) {
+    struct RecorderBlock *block;
+    unsigned char *p;
+    int32_t *touch;
+    int i, s;
+
+    if (!recorder->data || recorder->count == 0) {
+        return;
+    }
+    block = last_block(recorder);
+    // the SYN_DROPPED before it is in this block, the touches must be too
+    if (block->used + RESYNC_SIZE + count * MAX_TOUCH_SIZE > RECORDER_BLOCK_SIZE) {
+        count = (RECORDER_BLOCK_SIZE - block->used - RESYNC_SIZE) / MAX_TOUCH_SIZE;
+    }
+    p = block_data(recorder, block) + block->used;
+    *p++ = OP_RESYNC;
+    p = put_varint(p, current_slot_id + 1);
+    p = put_varint(p, count);
+    for (s = 0; s <= recorder->num_slots; ++s) {
+        recorder->touches[s * RECORDER_MT_CODES + COLUMN(ABS_MT_TRACKING_ID)] = -1;
+    }
+    for (i = 0; i < count; ++i) {
+        p = put_varint(p, touches[i].slot_id);
+        p = put_varint(p, zigzag(touches[i].x));
+        p = put_varint(p, zigzag(touches[i].y));
+        p = put_varint(p, zigzag(touches[i].pressure));
+        touch = &recorder->touches[slot_row(touches[i].slot_id, recorder->num_slots) * RECORDER_MT_CODES];
+        // the device does not say, any id >= 0 puts the touch down again
+        touch[COLUMN(ABS_MT_TRACKING_ID)] = touches[i].slot_id;
+        touch[COLUMN(ABS_MT_POSITION_X)] = touches[i].x;
+        touch[COLUMN(ABS_MT_POSITION_Y)] = touches[i].y;
+        touch[COLUMN(ABS_MT_PRESSURE)] = touches[i].pressure;
+    }
+    block->used = p - block_data(recorder, block);
+    recorder->slot = current_slot_id;
+}
+
+static void write_event(FILE *out, uint64_t time, int type, int code, int32_t value) {
+    fprintf(out, "E: %lu.%06lu %04x %04x %d\n", (unsigned long) (time / 1000000), (unsigned long) (time % 1000000),
+            type, code, value);
+}
+
+/* Decodes one block. The keyframe is written only for the first block of
+ * the file, later ones repeat what the events before said already. -1 if
+ * the block is corrupt. */
+static int write_block(const struct Recorder *recorder, const struct RecorderBlock *block, int first,
+                       int32_t *bases, int32_t *touch_bases, FILE *out) {
+    const unsigned char *p = block_data(recorder, block);
+    const unsigned char *end = p + block->used;
+    uint64_t time = block->start, value, type, code, count, x, y, pressure;
+    int in_keyframe = 0, keyframe_events = 0, slot = 0;
+    int op, index, i;
+    int32_t *base;
+
+    memset(bases, 0, RECORDER_CODES * sizeof(int32_t));
+    memset(touch_bases, 0, (recorder->num_slots + 1) * RECORDER_MT_CODES * sizeof(int32_t));
+    while (p && p < end) {
+        op = *p++;
+        index = op & OP_INDEX;
+        if (index == OP_KEYFRAME || index == OP_KEYFRAME_END) {
+            in_keyframe = index == OP_KEYFRAME;
+            if (!in_keyframe && first && keyframe_events > 0) {
+                write_event(out, time, EV_SYN, SYN_REPORT, 0);
+            }
+            continue;
+        }
+        if (index == OP_RESYNC) {
+            if (!(p = get_varint(p, end, &value)) || !(p = get_varint(p, end, &count))) {
+                break;
+            }
+            slot = (int) value - 1;
+            fprintf(out, "# resync: %d\n", slot);
+            for (i = 0; i < (int) count && p; ++i) {
+                if ((p = get_varint(p, end, &value)) && (p = get_varint(p, end, &x)) &&
+                    (p = get_varint(p, end, &y)) && (p = get_varint(p, end, &pressure))) {
+                    fprintf(out, "# touch: %d %d %d %d\n", (int) value, unzigzag(x), unzigzag(y), unzigzag(pressure));
+                }
+            }
+            continue;
+        }
+        if (op & OP_TIME) {
+            if (!(p = get_varint(p, end, &value))) {
+                break;
+            }
+            time += unzigzag(value);
+        }
+        if (index == OP_OTHER) {
+            if (!(p = get_varint(p, end, &type)) || !(p = get_varint(p, end, &code)) ||
+                !(p = get_varint(p, end, &value))) {
+                break;
+            }
+            write_event(out, time, type, code, unzigzag(value));
+            continue;
+        }
+        if (index >= RECORDER_CODES) {
+            break;
+        }
+        base = index >= FIRST_TOUCH ?
+            &touch_bases[slot_row(slot, recorder->num_slots) * RECORDER_MT_CODES + index - FIRST_TOUCH] : &bases[index];
+        if (op & OP_VALUE) {
+            if (!(p = get_varint(p, end, &value))) {
+                break;
+            }
+            *base = (uint32_t) *base + (uint32_t) unzigzag(value);
+        }
+        if (index == FIRST_MT) {
+            slot = *base;
+        }
+        if (in_keyframe) {
+            keyframe_events++;
+        }
+        if (!in_keyframe || first) {
+            write_event(out, time, codes[index].type, codes[index].code, *base);
+        }
+    }
+    return p == end ? 0 : -1;
+}
+
+/* Writes the blocks of the last max_age seconds as a random-record file.
+ * Runs on the thread that adds the events. 0 on success. */
+int recorder_write(const struct Recorder *recorder, FILE *out, const char *device) {
+    const struct RecorderBlock *block, *last;
+    int32_t bases[RECORDER_CODES];
+    int32_t *touch_bases;
+    int i, first, res = 0;
+
+    fprintf(out, "# random-record\n# flight recorder of %s\n# slots: %d\n", device, recorder->num_slots);
+    if (!recorder->data || recorder->count == 0) {
+        return ferror(out) ? -1 : 0;
+    }
+    touch_bases = calloc((recorder->num_slots + 1) * RECORDER_MT_CODES, sizeof(int32_t));
+    if (!touch_bases) {
+        return -1;
+    }
+    last = &recorder->blocks[(recorder->first + recorder->count - 1) % recorder->num_blocks];
+    first = 1;
+    for (i = 0; i < recorder->count; ++i) {
+        block = &recorder->blocks[(recorder->first + i) % recorder->num_blocks];
+        if (recorder->max_age > 0 && block->end + recorder->max_age < last->end) {
+            continue;
+        }
+        if (write_block(recorder, block, first, bases, touch_bases, out) != 0) {
+            res = -1;
+        }
+        first = 0;
+    }
+    free(touch_bases);
+    return ferror(out) || res != 0 ? -1 : 0;
+}
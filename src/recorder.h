@@ -0,0 +1,84 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The flight recorder: the raw events of the last minute or so, kept in
+ * memory so the events behind a misfire can still be saved after the user
+ * noticed it. recorder_write() turns them into a random-record file that
+ * random-replay plays back.
+ *
+ * Events are delta encoded into fixed size blocks, the oldest block is
+ * dropped when the ring is full. An event is an op byte (the index of its
+ * type and code in a table, and whether the time or the value changed),
+ * then the time since the previous event and the value minus the previous
+ * value of that code (of that slot for the MT codes) as varints. Most
+ * events take 2 to 4 bytes instead of the 24 of a struct input_event.
+ * Every block starts over from zero and with a keyframe of the touches
+ * down at that point, so a snapshot can start at any block. A pause too
+ * long for a 32 bit time delta starts a new block too.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define RECORDER_BLOCK_SIZE 4096
+
+// type and code of the events with an index in the op byte, see recorder.c
+#define RECORDER_CODES 27
+// ABS_MT_TOUCH_MAJOR to ABS_MT_DISTANCE, the per-slot values
+#define RECORDER_MT_CODES 12
+
+struct input_event;
+struct GestureTouch;
+
+struct RecorderBlock {
+    uint64_t start; // usec, the time the deltas of the block start from
+    uint64_t end; // usec, of its last event
+    uint32_t used; // bytes
+};
+
+struct Recorder {
+    unsigned char *data; // num_blocks blocks of RECORDER_BLOCK_SIZE, NULL when off
+    struct RecorderBlock *blocks;
+    int num_blocks;
+    int first; // the oldest block
+    int count; // blocks in use, the last one is written to
+    int full; // the last block is full, the next event starts a new one
+    uint64_t max_age; // usec, older blocks are not written out
+    uint64_t time; // of the previous event
+    int num_slots;
+    int slot; // ABS_MT_SLOT of the device
+    int32_t values[RECORDER_CODES]; // last value of every code
+    int32_t *touches; // (num_slots + 1) * RECORDER_MT_CODES, the last row for slots out of range
+    int32_t bases[RECORDER_CODES]; // what the deltas of the current block refer to
+    int32_t *touch_bases;
+};
+
+int recorder_init(struct Recorder *recorder, int num_slots, size_t size, int seconds);
+int recorder_copy(struct Recorder *copy, const struct Recorder *recorder);
+void recorder_free(struct Recorder *recorder);
+void recorder_add(struct Recorder *recorder, const struct input_event *ev);
+void recorder_add_resync(struct Recorder *recorder, const struct GestureTouch *touches, int count, int current_slot_id);
+int recorder_write(const struct Recorder *recorder, FILE *out, const char *device);
+
+#endif /* RECORDER_H */
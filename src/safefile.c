@@ -0,0 +1,52 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "safefile.h"
+
+/* Replaces path with a new empty file and opens it with the O_ACCMODE
+ * 'flags' given. -1 with errno set if that fails, EEXIST included: someone
+ * created the name again in between. */
+int safefile_create(const char *path, int flags, mode_t mode) {
+    if (unlink(path) != 0 && errno != ENOENT) {
+        return -1;
+    }
+    return open(path, flags | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, mode);
+}
+/* A new file only its owner can read, for writing with stdio. */
+FILE *safefile_fopen(const char *path) {
+    FILE *out;
+    int fd;
+
+    fd = safefile_create(path, O_WRONLY, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    out = fdopen(fd, "w");
+    if (!out) {
+        close(fd);
+        unlink(path);
+    }
+    return out;
+}
@@ -0,0 +1,36 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Files the driver writes into directories every user can write to, like
+ * /dev/shm and /var/tmp. Another user may have put a file or a symlink
+ * there under the same name first, so the driver removes whatever is there
+ * and creates a new file of its own, without following links.
+ */
+
+#ifndef SAFEFILE_H
+#define SAFEFILE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+int safefile_create(const char *path, int flags, mode_t mode);
+FILE *safefile_fopen(const char *path);
+
+#endif /* SAFEFILE_H */
@@ -0,0 +1,85 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include "simclock.h"
+
+static void sim_now(void *data, struct timeval *time) {
+    *time = ((struct SimClock *) data)->now;
+}
+
+static void sim_set_timer(void *data, int millis) {
+    struct SimClock *sim = data;
+    struct timeval interval;
+
+    interval.tv_sec = millis / 1000;
+    interval.tv_usec = (millis % 1000) * 1000;
+    timeradd(&sim->now, &interval, &sim->deadline);
+    sim->armed = 1;
+}
+
+static void sim_cancel_timer(void *data) {
+    ((struct SimClock *) data)->armed = 0;
+}
+
+static void fire(struct SimClock *sim, struct State *state) {
+    sim->armed = 0;
+    sim->now = sim->deadline;
+    sim->expiries++;
+    gesture_timer_expired(state);
+}
+
+/* Starts the clock at time 0 with no timer armed and points 'clock' at it,
+ * for gesture_init(). */
+void simclock_init(struct SimClock *sim, struct GestureClock *clock) {
+    timerclear(&sim->now);
+    timerclear(&sim->deadline);
+    sim->armed = 0;
+    sim->expiries = 0;
+    clock->now = sim_now;
+    clock->set_timer = sim_set_timer;
+    clock->cancel_timer = sim_cancel_timer;
+    clock->data = sim;
+}
+
+/* Moves the clock forward to 'time', firing every timeout that is due by
+ * then at its deadline. Expiring a timer can arm the next one (scroll
+ * momentum), those fire as well if they are due. */
+void simclock_advance(struct SimClock *sim, struct State *state, const struct timeval *time) {
+    while (sim->armed && !timercmp(&sim->deadline, time, >)) {
+        fire(sim, state);
+    }
+    sim->now = *time;
+}
+
+/* Fires the pending timeouts one after the other until none is armed, as
+ * if the touchpad was left alone for good. Returns -1 if one is still
+ * armed after max_expiries, a timer that keeps rearming itself. */
+int simclock_drain(struct SimClock *sim, struct State *state, int max_expiries) {
+    int fired;
+
+    for (fired = 0; sim->armed; ++fired) {
+        if (fired == max_expiries) {
+            return -1;
+        }
+        fire(sim, state);
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A virtual GestureClock for running the gesture engine without X and
+ * without waiting: time only moves when the caller says so, and a timeout
+ * fires as soon as the clock is moved past its deadline. Recorded or
+ * generated input of hours runs through the engine in seconds, and the
+ * output depends on nothing but the input.
+ */
+
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <sys/time.h>
+
+#include "gesture.h"
+
+struct SimClock {
+    struct timeval now;
+    struct timeval deadline;
+    int armed;
+    unsigned long expiries; // timeouts fired so far
+};
+
+void simclock_init(struct SimClock *sim, struct GestureClock *clock);
+void simclock_advance(struct SimClock *sim, struct State *state, const struct timeval *time);
+int simclock_drain(struct SimClock *sim, struct State *state, int max_expiries);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "safefile.h"
+#include "stats.h"
+
+/* Creates the file, replacing a stale one, and maps it for writing. NULL
+ * if that fails, the driver then runs without statistics. */
+struct GestureStats *stats_create(const char *path) {
+    struct GestureStats *stats;
+    int fd;
+
+    fd = safefile_create(path, O_RDWR, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct GestureStats)) != 0) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    stats = mmap(NULL, sizeof(struct GestureStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED) {
+        unlink(path);
+        return NULL;
+    }
+    // the file is all zeros, the magic goes last so readers skip it until then
+    stats->version = STATS_VERSION;
+    stats->size = sizeof(struct GestureStats);
+    stats->pid = getpid();
+    __atomic_store_n(&stats->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+    return stats;
+}
+void stats_destroy(struct GestureStats *stats, const char *path) {
+    munmap(stats, sizeof(struct GestureStats));
+    unlink(path);
+}
+/* Maps a file of stats_create() read-only, NULL if it is not one of this
+ * version. */
+const struct GestureStats *stats_open(const char *path) {
+    struct GestureStats *stats;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct GestureStats)) {
+        close(fd);
+        return NULL;
+    }
+    stats = mmap(NULL, sizeof(struct GestureStats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED) {
+        return NULL;
+    }
+    if (__atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+        stats->version != STATS_VERSION || stats->size != sizeof(struct GestureStats)) {
+        munmap(stats, sizeof(struct GestureStats));
+        return NULL;
+    }
+    return stats;
+}
+void stats_close(const struct GestureStats *stats) {
+    munmap((void *) stats, sizeof(struct GestureStats));
+}
+int stats_bucket(uint64_t value) {
+    int bucket;
+
+    if (value == 0) {
+        return 0;
+    }
+    bucket = 64 - __builtin_clzll(value);
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+/* The smallest value that does not go into 'bucket' any more. */
+uint64_t stats_bucket_limit(int bucket) {
+    return bucket == 0 ? 1 : (uint64_t) 1 << bucket;
+}
@@ -0,0 +1,86 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Live statistics of the driver, in a file mapped into memory so a viewer
+ * (random-stats) can read them while X runs. There is one writer, the
+ * thread that runs the gesture engine: it stores every counter with a
+ * relaxed atomic store, readers load them the same way. Counters never go
+ * back, a reader gets rates from the difference of two samples.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_MAGIC 0x54534452 // "RDST" in the file
+#define STATS_VERSION 2
+
+// touchpad states the file has room for, at least the number of enum TouchpadStates
+#define STATS_STATES 8
+
+// bucket 0 counts 0, bucket i counts [2^(i-1), 2^i), the last one all above
+#define STATS_BUCKETS 24
+
+struct StatsHistogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t buckets[STATS_BUCKETS];
+};
+
+struct GestureStats {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size; // sizeof(struct GestureStats)
+    uint32_t pid; // of the writer
+    uint64_t started; // usec on the writer's clock
+    uint64_t updated; // usec, the last frame or timeout
+    uint64_t frames;
+    uint64_t events;
+    uint64_t posted; // motion, button and scroll calls to the X server
+    uint64_t momentum_ticks;
+    uint64_t syn_dropped;
+    uint64_t state_entries[STATS_STATES];
+    uint64_t state_usec[STATS_STATES]; // time spent in a state, counted when it is left
+    struct StatsHistogram events_per_frame;
+    struct StatsHistogram latency_usec; // event timestamp to the post
+};
+
+struct GestureStats *stats_create(const char *path);
+void stats_destroy(struct GestureStats *stats, const char *path);
+const struct GestureStats *stats_open(const char *path);
+void stats_close(const struct GestureStats *stats);
+int stats_bucket(uint64_t value);
+uint64_t stats_bucket_limit(int bucket);
+
+static inline uint64_t stats_load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+/* Only the writer changes a counter, so this needs no atomic add. */
+static inline void stats_add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+static inline void stats_record(struct StatsHistogram *histogram, uint64_t value) {
+    stats_add(&histogram->buckets[stats_bucket(value)], 1);
+    stats_add(&histogram->sum, value);
+    stats_add(&histogram->count, 1);
+}
+
+#endif /* STATS_H */
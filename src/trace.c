@@ -0,0 +1,129 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* This file must not include any X server header, see gesture.h. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+static const char *const type_names[TRACE_NUM_TYPES] = {
+    [TRACE_STATE] = "state",
+    [TRACE_RESYNC] = "resync",
+    [TRACE_SLOT_RANGE] = "slot-range",
+    [TRACE_MOMENTUM] = "momentum",
+    [TRACE_MOTION] = "motion",
+    [TRACE_BUTTON] = "button",
+    [TRACE_SCROLL] = "scroll",
+    [TRACE_FRAME] = "frame",
+    [TRACE_SLOT] = "slot",
+    [TRACE_TIMER] = "timer",
+    [TRACE_EVENT] = "event",
+};
+
+/* Allocates the ring, -1 if there is no memory for it. */
+int trace_init(struct Trace *trace, int level) {
+    memset(trace, 0, sizeof(*trace));
+    trace->records = calloc(TRACE_RECORDS, sizeof(struct TraceRecord));
+    if (!trace->records) {
+        return -1;
+    }
+    trace_set_level(trace, level);
+    return 0;
+}
+/* A snapshot of the ring to write out while the engine goes on, free it
+ * with trace_free(). -1 if there is no memory for it. */
+int trace_copy(struct Trace *copy, const struct Trace *trace) {
+    *copy = *trace;
+    copy->records = malloc(TRACE_RECORDS * sizeof(struct TraceRecord));
+    if (!copy->records) {
+        return -1;
+    }
+    memcpy(copy->records, trace->records, TRACE_RECORDS * sizeof(struct TraceRecord));
+    return 0;
+}
+void trace_free(struct Trace *trace) {
+    free(trace->records);
+    trace->records = NULL;
+    trace->level = TRACE_LEVEL_OFF;
+}
+void trace_set_level(struct Trace *trace, int level) {
+    if (level < TRACE_LEVEL_OFF) {
+        level = TRACE_LEVEL_OFF;
+    } else if (level >= TRACE_NUM_LEVELS) {
+        level = TRACE_NUM_LEVELS - 1;
+    }
+    __atomic_store_n(&trace->level, level, __ATOMIC_RELAXED);
+}
+/* The index of a constant string for a record, -1 if the table is full.
+ * The strings are compared by address, they must outlive the trace. */
+int trace_string(struct Trace *trace, const char *string) {
+    int i;
+
+    if (!string) {
+        return -1;
+    }
+    for (i = 0; i < trace->num_strings; ++i) {
+        if (trace->strings[i] == string) {
+            return i;
+        }
+    }
+    if (trace->num_strings == TRACE_STRINGS) {
+        return -1;
+    }
+    trace->strings[trace->num_strings] = string;
+    return trace->num_strings++;
+}
+/* Writes the ring as described at struct TraceFileHeader. Must not run
+ * while records are added, the driver calls it from the thread that adds
+ * them. -1 if writing failed. */
+int trace_dump(const struct Trace *trace, FILE *out) {
+    struct TraceFileHeader header;
+    uint32_t first, i;
+    int s;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(struct TraceRecord);
+    header.num_records = trace->head < TRACE_RECORDS ? trace->head : TRACE_RECORDS;
+    header.num_strings = trace->num_strings;
+    for (s = 0; s < trace->num_strings; ++s) {
+        header.strings_size += strlen(trace->strings[s]) + 1;
+    }
+    if (fwrite(&header, sizeof(header), 1, out) != 1) {
+        return -1;
+    }
+    for (s = 0; s < trace->num_strings; ++s) {
+        if (fwrite(trace->strings[s], strlen(trace->strings[s]) + 1, 1, out) != 1) {
+            return -1;
+        }
+    }
+    first = trace->head - header.num_records;
+    for (i = 0; i < header.num_records; ++i) {
+        if (fwrite(&trace->records[(first + i) & (TRACE_RECORDS - 1)], sizeof(struct TraceRecord), 1, out) != 1) {
+            return -1;
+        }
+    }
+    return fflush(out) == 0 ? 0 : -1;
+}
+const char *trace_type_name(int type) {
+    return type >= 0 && type < TRACE_NUM_TYPES ? type_names[type] : "unknown";
+}
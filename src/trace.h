@@ -0,0 +1,121 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A fixed ring of binary trace records, written by the gesture engine as it
+ * goes and dumped to a file on request; random-trace decodes the dump. A
+ * record is a few stores into memory allocated at init, and nothing at all
+ * below the level it belongs to, so tracing can stay on.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC 0x43525452 // "RTRC" in the file
+#define TRACE_VERSION 2
+
+// records kept, the oldest are overwritten; a power of 2
+#define TRACE_RECORDS 4096
+// different messages of state changes, see trace_string()
+#define TRACE_STRINGS 32
+
+enum TraceLevel {
+    TRACE_LEVEL_OFF,
+    TRACE_LEVEL_STATE, // state changes, resyncs, scroll momentum
+    TRACE_LEVEL_POSTED, // motion, buttons and scrolling sent to the X server
+    TRACE_LEVEL_FRAMES, // every frame with its active slots, timeouts
+    TRACE_LEVEL_EVENTS, // every input event
+    TRACE_NUM_LEVELS,
+};
+
+enum TraceType {
+    TRACE_STATE, // v0: old state, v1: new state, v2: message string or -1
+    TRACE_RESYNC, // v0: touches, v1: resyncs so far
+    TRACE_SLOT_RANGE, // v0: the ABS_MT_SLOT value, v1: slots of the device
+    TRACE_MOMENTUM, // v0, v1: velocity in 1/1000 wheel clicks per tick
+    TRACE_MOTION, // v0: dx, v1: dy
+    TRACE_BUTTON, // v0: button, v1: press
+    TRACE_SCROLL, // v0, v1: distance in 1/1000 wheel clicks
+    TRACE_FRAME, // v0: active slots, v1: before, v2: state
+    TRACE_SLOT, // id: slot, v0: x, v1: y, v2: pressure, v3: msec since the touch began
+    TRACE_TIMER, // v0: enum GestureTimer
+    TRACE_EVENT, // v0: type, v1: code, v2: value
+    TRACE_NUM_TYPES,
+};
+
+struct TraceRecord {
+    uint64_t time; // usec, of the frame or timeout being handled
+    uint16_t type; // enum TraceType
+    uint16_t id;
+    int32_t v[4];
+    uint32_t unused; // keeps the size at 32 bytes
+};
+
+struct Trace {
+    int level; // enum TraceLevel, may be changed from another thread
+    uint32_t head; // records written so far
+    uint64_t now; // time stamp of the next records
+    struct TraceRecord *records; // TRACE_RECORDS
+    const char *strings[TRACE_STRINGS];
+    int num_strings;
+};
+
+/* The dump: this header, num_strings nul terminated strings, then
+ * num_records records, oldest first. */
+struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_records;
+    uint32_t num_strings;
+    uint32_t strings_size; // bytes, with the terminators
+};
+
+int trace_init(struct Trace *trace, int level);
+int trace_copy(struct Trace *copy, const struct Trace *trace);
+void trace_free(struct Trace *trace);
+void trace_set_level(struct Trace *trace, int level);
+int trace_string(struct Trace *trace, const char *string);
+int trace_dump(const struct Trace *trace, FILE *out);
+const char *trace_type_name(int type);
+
+static inline int trace_enabled(const struct Trace *trace, int level) {
+    return __atomic_load_n(&trace->level, __ATOMIC_RELAXED) >= level;
+}
+static inline void trace_record(struct Trace *trace, int level, int type, int id,
+                                int32_t v0, int32_t v1, int32_t v2, int32_t v3) {
+    struct TraceRecord *record;
+
+    if (!trace_enabled(trace, level)) {
+        return;
+    }
+    record = &trace->records[trace->head++ & (TRACE_RECORDS - 1)];
+    record->time = trace->now;
+    record->type = type;
+    record->id = id;
+    record->v[0] = v0;
+    record->v[1] = v1;
+    record->v[2] = v2;
+    record->v[3] = v3;
+}
+
+#endif /* TRACE_H */
@@ -0,0 +1,410 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Per-frame microbenchmark of the gesture engine ("make bench").
+ *
+ * For every finger count and report rate a synthetic multitouch stream is
+ * generated up front and then fed through the engine twice: once through
+ * process_event() as the driver does, for the totals, and once with the
+ * EV_SYN stages called one by one so each can be measured on its own.
+ * Cycles and cache misses come from perf_event_open (user space only); if
+ * the kernel does not allow that (perf_event_paranoid) they print as "-".
+ */
+
+#include <linux/input.h>
+#include <linux/perf_event.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gesture.h"
+#include "simclock.h"
+
+#define BENCH_FRAMES        20000
+#define BENCH_STROKE_FRAMES 200   /* fingers are lifted and put back after this many frames */
+#define BENCH_MAX_FINGERS   5
+#define BENCH_SLOTS         16    /* like bcm5974 */
+
+enum BenchStage {
+    STAGE_ELAPSED,
+    STAGE_FILTER,
+    STAGE_VELOCITY,
+    STAGE_EV_SYN,
+    STAGE_SAVE,
+    NUM_STAGES,
+};
+
+static const char *stage_names[NUM_STAGES] = {
+    "calculate_elapsed_useconds_and_active_slots",
+    "filter_slots",
+    "estimate_velocities",
+    "process_EV_SYN",
+    "save_current_values_to_prev",
+};
+
+struct Counters {
+    int cycles_fd;
+    int misses_fd;
+};
+
+struct Measurement {
+    int64_t ns;
+    uint64_t cycles;
+    uint64_t misses;
+};
+
+struct Bench {
+    struct SimClock sim;
+    unsigned long posted;
+};
+
+static void bench_motion(void *data, int dx, int dy)
+{
+    ((struct Bench *) data)->posted++;
+}
+
+static void bench_button(void *data, int button, int is_press)
+{
+    ((struct Bench *) data)->posted++;
+}
+
+static void bench_scroll(void *data, double dx, double dy)
+{
+    ((struct Bench *) data)->posted++;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int open_counter(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void counters_open(struct Counters *counters)
+{
+    counters->cycles_fd = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    counters->misses_fd = -1;
+    if (counters->cycles_fd >= 0) {
+        counters->misses_fd = open_counter(PERF_COUNT_HW_CACHE_MISSES, counters->cycles_fd);
+    }
+}
+
+static void counters_close(struct Counters *counters)
+{
+    if (counters->misses_fd >= 0) {
+        close(counters->misses_fd);
+    }
+    if (counters->cycles_fd >= 0) {
+        close(counters->cycles_fd);
+    }
+}
+
+static void counters_start(struct Counters *counters)
+{
+    if (counters->cycles_fd >= 0) {
+        ioctl(counters->cycles_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+static void counters_stop(struct Counters *counters)
+{
+    if (counters->cycles_fd >= 0) {
+        ioctl(counters->cycles_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+static void counters_reset(struct Counters *counters)
+{
+    if (counters->cycles_fd >= 0) {
+        ioctl(counters->cycles_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+static void counters_read(struct Counters *counters, struct Measurement *m)
+{
+    uint64_t value;
+
+    m->cycles = UINT64_MAX;
+    m->misses = UINT64_MAX;
+    if (counters->cycles_fd >= 0 && read(counters->cycles_fd, &value, sizeof(value)) == sizeof(value)) {
+        m->cycles = value;
+    }
+    if (counters->misses_fd >= 0 && read(counters->misses_fd, &value, sizeof(value)) == sizeof(value)) {
+        m->misses = value;
+    }
+}
+
+static void add_event(struct input_event *ev, int *count, struct timeval *time, int type, int code, int value)
+{
+    ev[*count].time = *time;
+    ev[*count].type = type;
+    ev[*count].code = code;
+    ev[*count].value = value;
+    (*count)++;
+}
+
+/* Builds a stream of BENCH_FRAMES frames of 'fingers' fingers moving to the
+ * right, laid out the way bcm5974 reports them. */
+static struct input_event *generate_stream(int fingers, int rate, int *num_events)
+{
+    struct input_event *ev;
+    struct timeval time;
+    int frame, finger, count = 0, tracking_id = 1;
+    int in_stroke, stroke_frame;
+
+    ev = calloc((size_t) BENCH_FRAMES * (BENCH_MAX_FINGERS * 9 + 8), sizeof(*ev));
+    if (!ev) {
+        return NULL;
+    }
+    time.tv_sec = 1000;
+    time.tv_usec = 0;
+    for (frame = 0; frame < BENCH_FRAMES; ++frame) {
+        stroke_frame = frame % BENCH_STROKE_FRAMES;
+        in_stroke = stroke_frame < BENCH_STROKE_FRAMES - 1;
+        for (finger = 0; finger < fingers; ++finger) {
+            if (fingers > 1) {
+                add_event(ev, &count, &time, EV_ABS, ABS_MT_SLOT, finger);
+            }
+            if (!in_stroke) {
+                add_event(ev, &count, &time, EV_ABS, ABS_MT_TRACKING_ID, -1);
+                continue;
+            }
+            if (stroke_frame == 0) {
+                add_event(ev, &count, &time, EV_ABS, ABS_MT_TRACKING_ID, tracking_id++);
+            }
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_TOUCH_MAJOR, 700 + (frame & 7));
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_TOUCH_MINOR, 600 - (frame & 7));
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_WIDTH_MAJOR, 800 + (frame & 3));
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_WIDTH_MINOR, 700 - (frame & 3));
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_ORIENTATION, (frame & 15) - 8);
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_POSITION_X, -3000 + finger * 900 + stroke_frame * 20);
+            add_event(ev, &count, &time, EV_ABS, ABS_MT_POSITION_Y, 2000 + finger * 100 + stroke_frame * 5);
+        }
+        add_event(ev, &count, &time, EV_ABS, ABS_X, -3000 + stroke_frame * 20);
+        add_event(ev, &count, &time, EV_ABS, ABS_Y, 2000 + stroke_frame * 5);
+        add_event(ev, &count, &time, EV_ABS, ABS_PRESSURE, in_stroke ? 60 + (frame & 3) : 0);
+        add_event(ev, &count, &time, EV_ABS, ABS_TOOL_WIDTH, in_stroke ? 8 : 0);
+        add_event(ev, &count, &time, EV_SYN, SYN_REPORT, 0);
+        time.tv_usec += 1000000 / rate;
+        if (time.tv_usec >= 1000000) {
+            time.tv_sec++;
+            time.tv_usec -= 1000000;
+        }
+    }
+    *num_events = count;
+    return ev;
+}
+
+static void init_state(struct State *state, struct Bench *bench)
+{
+    struct GestureSink sink;
+    struct GestureClock clock;
+
+    memset(bench, 0, sizeof(*bench));
+    sink.motion = bench_motion;
+    sink.button = bench_button;
+    sink.scroll = bench_scroll;
+    sink.data = bench;
+    simclock_init(&bench->sim, &clock);
+    if (gesture_init(state, BENCH_SLOTS, &sink, &clock) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+}
+
+/* The whole stream through process_event(), exactly as RandomReadInput does. */
+static void bench_total(struct State *state, struct input_event *ev, int num_events,
+                        struct Counters *counters, struct Measurement *m)
+{
+    struct Bench bench;
+    uint64_t start;
+    int i;
+
+    init_state(state, &bench);
+    counters_reset(counters);
+    start = now_ns();
+    counters_start(counters);
+    for (i = 0; i < num_events; ++i) {
+        if (bench.sim.armed) {
+            simclock_advance(&bench.sim, state, &ev[i].time);
+        }
+        bench.sim.now = ev[i].time;
+        process_event(state, &ev[i].time, ev[i].type, ev[i].code, ev[i].value);
+    }
+    counters_stop(counters);
+    m->ns = now_ns() - start;
+    counters_read(counters, m);
+    gesture_free(state);
+}
+
+/* Same stream, but the EV_SYN case of process_event() is unrolled here so
+ * every stage is measured separately. Keep it in sync with process_event(). */
+static void bench_stages(struct State *state, struct input_event *ev, int num_events,
+                         struct Counters counters[NUM_STAGES], struct Measurement m[NUM_STAGES])
+{
+    struct Bench bench;
+    struct Measurement stage;
+    uint64_t start, overhead;
+    int i, s;
+
+    init_state(state, &bench);
+    for (s = 0; s < NUM_STAGES; ++s) {
+        counters_reset(&counters[s]);
+        m[s].ns = 0;
+    }
+    /* cost of the two now_ns() calls around each stage */
+    start = now_ns();
+    for (i = 0; i < 1000; ++i) {
+        now_ns();
+    }
+    overhead = (now_ns() - start) / 1000;
+
+    for (i = 0; i < num_events; ++i) {
+        if (bench.sim.armed) {
+            simclock_advance(&bench.sim, state, &ev[i].time);
+        }
+        bench.sim.now = ev[i].time;
+        if (ev[i].type != EV_SYN) {
+            process_event(state, &ev[i].time, ev[i].type, ev[i].code, ev[i].value);
+            continue;
+        }
+        start = now_ns();
+        counters_start(&counters[STAGE_ELAPSED]);
+        calculate_elapsed_useconds_and_active_slots(state, &ev[i].time);
+        counters_stop(&counters[STAGE_ELAPSED]);
+        m[STAGE_ELAPSED].ns += (int64_t) (now_ns() - start - overhead);
+
+        start = now_ns();
+        counters_start(&counters[STAGE_FILTER]);
+        filter_slots(state);
+        counters_stop(&counters[STAGE_FILTER]);
+        m[STAGE_FILTER].ns += (int64_t) (now_ns() - start - overhead);
+
+        start = now_ns();
+        counters_start(&counters[STAGE_VELOCITY]);
+        estimate_velocities(state);
+        counters_stop(&counters[STAGE_VELOCITY]);
+        m[STAGE_VELOCITY].ns += (int64_t) (now_ns() - start - overhead);
+
+        start = now_ns();
+        counters_start(&counters[STAGE_EV_SYN]);
+        process_EV_SYN(state, &ev[i].time);
+        counters_stop(&counters[STAGE_EV_SYN]);
+        m[STAGE_EV_SYN].ns += (int64_t) (now_ns() - start - overhead);
+
+        start = now_ns();
+        counters_start(&counters[STAGE_SAVE]);
+        save_current_values_to_prev(state);
+        counters_stop(&counters[STAGE_SAVE]);
+        m[STAGE_SAVE].ns += (int64_t) (now_ns() - start - overhead);
+    }
+    for (s = 0; s < NUM_STAGES; ++s) {
+        counters_read(&counters[s], &stage);
+        m[s].cycles = stage.cycles;
+        m[s].misses = stage.misses;
+    }
+    gesture_free(state);
+}
+
+static void print_counter(uint64_t value, int frames)
+{
+    if (value == UINT64_MAX) {
+        printf(" %12s", "-");
+    } else {
+        printf(" %12.1f", (double) value / frames);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const int finger_counts[] = { 1, 2, 3, 5 };
+    static const int rates[] = { 125, 250, 500 };
+    static struct State state;
+    struct Counters total_counters, stage_counters[NUM_STAGES];
+    struct Measurement total, stages[NUM_STAGES];
+    struct input_event *ev;
+    int f, r, s, num_events;
+
+    counters_open(&total_counters);
+    for (s = 0; s < NUM_STAGES; ++s) {
+        counters_open(&stage_counters[s]);
+    }
+    if (total_counters.cycles_fd < 0) {
+        fprintf(stderr, "perf_event_open failed (%s), cycles and cache misses are not available\n", strerror(errno));
+    }
+
+    printf("%d frames per run, all values per frame unless noted\n\n", BENCH_FRAMES);
+    printf("%-7s %-5s %12s %12s %12s %12s %12s\n",
+           "fingers", "Hz", "events", "ns", "ns/event", "cycles", "cache-miss");
+    for (f = 0; f < (int) (sizeof(finger_counts) / sizeof(finger_counts[0])); ++f) {
+        for (r = 0; r < (int) (sizeof(rates) / sizeof(rates[0])); ++r) {
+            ev = generate_stream(finger_counts[f], rates[r], &num_events);
+            if (!ev) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            bench_total(&state, ev, num_events, &total_counters, &total);
+            bench_stages(&state, ev, num_events, stage_counters, stages);
+
+            printf("%-7d %-5d %12.1f %12.1f %12.1f",
+                   finger_counts[f], rates[r], (double) num_events / BENCH_FRAMES,
+                   (double) total.ns / BENCH_FRAMES, (double) total.ns / num_events);
+            print_counter(total.cycles, BENCH_FRAMES);
+            print_counter(total.misses, BENCH_FRAMES);
+            printf("\n");
+            for (s = 0; s < NUM_STAGES; ++s) {
+                printf("  %-45s %12.1f", stage_names[s], (double) stages[s].ns / BENCH_FRAMES);
+                print_counter(stages[s].cycles, BENCH_FRAMES);
+                print_counter(stages[s].misses, BENCH_FRAMES);
+                printf("\n");
+            }
+            free(ev);
+        }
+    }
+
+    counters_close(&total_counters);
+    for (s = 0; s < NUM_STAGES; ++s) {
+        counters_close(&stage_counters[s]);
+    }
+    return 0;
+}
@@ -0,0 +1,716 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Property based fuzzer of the gesture engine, run by "make check".
+ *
+ * Every case is a random touch session made up of gestures: fingers that
+ * land, move, lift and come back, the button pressed and released, the
+ * kernel dropping events, the device switched off and on again, frames
+ * late or early, pauses from nothing to an hour. It runs through the engine on a SimClock, so hours of input take
+ * milliseconds, and whatever the input, these must hold:
+ *
+ *  - a button is only pressed while up and only released while down
+ *  - motion and scroll are finite and bounded
+ *  - once the fingers are gone and the timeouts ran out, no button is held,
+ *    the state is back to default and no timeout is pending, and the same
+ *    right after the device is switched off
+ *  - a timeout does not keep rearming itself forever
+ *
+ * A failing case is shrunk, by dropping frames as long as it still fails
+ * the same way, and written as a random-record file that random-replay
+ * plays back. Every case has its own seed, "-s <seed> -n 1" reruns one.
+ */
+
+#include <linux/input.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gesture.h"
+#include "simclock.h"
+
+#define FUZZ_SLOTS 16
+#define FUZZ_MAX_TOUCHES 5
+#define FUZZ_MAX_FRAMES 8192
+#define FUZZ_MAX_GESTURES 40
+
+/* bcm5974 coordinates */
+#define FUZZ_X_MIN -4800
+#define FUZZ_X_MAX 4800
+#define FUZZ_Y_MIN -200
+#define FUZZ_Y_MAX 7000
+
+/* the kernel drops the events before this many frames in a thousand */
+#define FUZZ_DROPS 3
+
+/* the device is off for the gap before this many frames in a thousand */
+#define FUZZ_SUSPENDS 2
+
+/* after this long without a finger the engine must be idle */
+#define QUIET_USEC 10000000UL
+
+#define MAX_EXPIRIES 100000
+#define MAX_MOTION 100000
+#define MAX_SCROLL 100000.0
+
+#define DEFAULT_CASES 500
+#define DEFAULT_OUTPUT "random-fuzz.rec"
+
+enum Property {
+    PROPERTY_NONE,
+    PROPERTY_BUTTONS, // press while down or release while up
+    PROPERTY_OUTPUT, // motion or scroll out of range
+    PROPERTY_IDLE, // something left over after the fingers are gone
+    PROPERTY_TIMERS, // a timeout keeps rearming
+};
+
+struct FuzzTouch {
+    int slot;
+    int id;
+    int x;
+    int y;
+    int pressure;
+};
+
+/* All touches at one SYN_REPORT; the events are the difference to the
+ * frame before. */
+struct FuzzFrame {
+    unsigned long gap; // usec since the frame before
+    int dropped; // the kernel dropped the events up to this frame
+    int suspended; // the device was switched off for the gap before this frame
+    int button;
+    int count;
+    struct FuzzTouch touches[FUZZ_MAX_TOUCHES];
+};
+
+struct Case {
+    struct FuzzFrame *frames;
+    int count;
+};
+
+struct Generator {
+    uint64_t seed;
+    struct Case *c;
+    struct FuzzFrame cur;
+    int next_id;
+    unsigned long pause; // added to the gap of the next frame
+};
+
+struct Fuzz {
+    struct State state;
+    struct SimClock sim;
+    unsigned int pressed; // buttons down as seen by the sink
+    enum Property failed;
+    char message[256];
+    FILE *record;
+    // the device as of the last frame, for the differences
+    struct FuzzTouch slots[FUZZ_SLOTS];
+    int slot;
+    int button;
+    struct input_event events[FUZZ_SLOTS * 6 + 2];
+    int count;
+};
+
+static uint64_t next_random(uint64_t *seed)
+{
+    uint64_t z = (*seed += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* uniform in [lo, hi] */
+static long between(uint64_t *seed, long lo, long hi)
+{
+    return lo + (long) (next_random(seed) % (uint64_t) (hi - lo + 1));
+}
+
+static int chance(uint64_t *seed, int percent)
+{
+    return between(seed, 0, 99) < percent;
+}
+
+static int clamp(int value, int lo, int hi)
+{
+    return value < lo ? lo : value > hi ? hi : value;
+}
+
+/* Mostly the report rate of the device, sometimes a burst or a stall. */
+static unsigned long frame_gap(uint64_t *seed)
+{
+    int r = between(seed, 0, 99);
+
+    if (r < 90) {
+        return between(seed, 7000, 9000);
+    }
+    if (r < 95) {
+        return between(seed, 0, 2000);
+    }
+    return between(seed, 20000, 300000);
+}
+
+/* Between gestures: quick enough for a double tap or to continue a drag,
+ * a moment, a while, or the user went away. */
+static unsigned long pause_gap(uint64_t *seed)
+{
+    int r = between(seed, 0, 99);
+
+    if (r < 40) {
+        return between(seed, 8000, 300000);
+    }
+    if (r < 70) {
+        return between(seed, 300000, 2000000);
+    }
+    if (r < 95) {
+        return between(seed, 2000000, 30000000);
+    }
+    return between(seed, 60, 3600) * 1000000UL;
+}
+
+static void emit(struct Generator *gen, unsigned long gap)
+{
+    struct FuzzFrame *frame;
+
+    if (gen->c->count == FUZZ_MAX_FRAMES) {
+        return;
+    }
+    frame = &gen->c->frames[gen->c->count++];
+    *frame = gen->cur;
+    frame->gap = gap + gen->pause;
+    frame->dropped = between(&gen->seed, 0, 999) < FUZZ_DROPS;
+    frame->suspended = between(&gen->seed, 0, 999) < FUZZ_SUSPENDS;
+    gen->pause = 0;
+}
+
+static int slot_used(const struct FuzzFrame *frame, int slot)
+{
+    int i;
+
+    for (i = 0; i < frame->count; ++i) {
+        if (frame->touches[i].slot == slot) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A finger lands in a free slot, near the others if there are any. */
+static void touch_down(struct Generator *gen)
+{
+    struct FuzzFrame *cur = &gen->cur;
+    struct FuzzTouch *touch;
+    int slot;
+
+    if (cur->count == FUZZ_MAX_TOUCHES) {
+        return;
+    }
+    do {
+        slot = between(&gen->seed, 0, FUZZ_SLOTS - 1);
+    } while (slot_used(cur, slot));
+    touch = &cur->touches[cur->count];
+    touch->slot = slot;
+    touch->id = gen->next_id++;
+    if (cur->count > 0) {
+        touch->x = clamp(cur->touches[0].x + between(&gen->seed, -1500, 1500), FUZZ_X_MIN, FUZZ_X_MAX);
+        touch->y = clamp(cur->touches[0].y + between(&gen->seed, -1500, 1500), FUZZ_Y_MIN, FUZZ_Y_MAX);
+    } else {
+        touch->x = between(&gen->seed, FUZZ_X_MIN, FUZZ_X_MAX);
+        touch->y = between(&gen->seed, FUZZ_Y_MIN, FUZZ_Y_MAX);
+    }
+    touch->pressure = between(&gen->seed, 20, 120);
+    cur->count++;
+}
+
+static void lift(struct Generator *gen, int i)
+{
+    gen->cur.touches[i] = gen->cur.touches[--gen->cur.count];
+}
+
+static void move(struct Generator *gen, int vx, int vy, int noise)
+{
+    struct FuzzTouch *touch;
+    int i;
+
+    for (i = 0; i < gen->cur.count; ++i) {
+        touch = &gen->cur.touches[i];
+        touch->x = clamp(touch->x + vx + between(&gen->seed, -noise, noise), FUZZ_X_MIN, FUZZ_X_MAX);
+        touch->y = clamp(touch->y + vy + between(&gen->seed, -noise, noise), FUZZ_Y_MIN, FUZZ_Y_MAX);
+    }
+}
+
+/* One gesture: a tap or a stroke of 1 to 5 fingers that land together or
+ * one after the other, with the odd finger or click in between. */
+static void gesture(struct Generator *gen)
+{
+    uint64_t *seed = &gen->seed;
+    int r = between(seed, 0, 99);
+    int fingers, frames, vx, vy, noise, i;
+
+    fingers = r < 35 ? 1 : r < 65 ? 2 : r < 90 ? 3 : between(seed, 4, 5);
+    frames = chance(seed, 30) ? between(seed, 1, 4) : between(seed, 5, 200);
+    vx = between(seed, -80, 80);
+    vy = between(seed, -80, 80);
+    noise = chance(seed, 90) ? between(seed, 0, 5) : between(seed, 0, 2000);
+
+    for (i = 0; i < fingers; ++i) {
+        touch_down(gen);
+        if (i == fingers - 1 || chance(seed, 50)) {
+            emit(gen, frame_gap(seed));
+        }
+    }
+    for (i = 0; i < frames; ++i) {
+        move(gen, vx, vy, noise);
+        r = between(seed, 0, 99);
+        if (r < 2) {
+            touch_down(gen);
+        } else if (r < 4 && gen->cur.count > 1) {
+            lift(gen, between(seed, 0, gen->cur.count - 1));
+        } else if (r < 6) {
+            gen->cur.button = !gen->cur.button;
+        }
+        emit(gen, frame_gap(seed));
+    }
+    while (gen->cur.count > 0) {
+        lift(gen, between(seed, 0, gen->cur.count - 1));
+        if (gen->cur.count == 0 || chance(seed, 50)) {
+            emit(gen, frame_gap(seed));
+        }
+    }
+    if (gen->cur.button) {
+        gen->cur.button = 0;
+        emit(gen, frame_gap(seed));
+    }
+    gen->pause = pause_gap(seed);
+}
+
+static void generate(struct Case *c, uint64_t seed)
+{
+    struct Generator gen;
+    int gestures, i;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.seed = seed;
+    gen.c = c;
+    gen.next_id = 1;
+    c->count = 0;
+    gestures = between(&gen.seed, 1, FUZZ_MAX_GESTURES);
+    for (i = 0; i < gestures && c->count < FUZZ_MAX_FRAMES; ++i) {
+        gesture(&gen);
+    }
+}
+
+static void fail(struct Fuzz *fuzz, enum Property property, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void fail(struct Fuzz *fuzz, enum Property property, const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    if (fuzz->failed != PROPERTY_NONE) {
+        return;
+    }
+    fuzz->failed = property;
+    len = snprintf(fuzz->message, sizeof(fuzz->message), "%lu.%06lu: ",
+                   (unsigned long) fuzz->sim.now.tv_sec, (unsigned long) fuzz->sim.now.tv_usec);
+    va_start(args, format);
+    vsnprintf(fuzz->message + len, sizeof(fuzz->message) - len, format, args);
+    va_end(args);
+}
+
+static void fuzz_motion(void *data, int dx, int dy)
+{
+    struct Fuzz *fuzz = data;
+
+    if (abs(dx) > MAX_MOTION || abs(dy) > MAX_MOTION) {
+        fail(fuzz, PROPERTY_OUTPUT, "motion %d %d", dx, dy);
+    }
+}
+
+static void fuzz_button(void *data, int button, int is_press)
+{
+    struct Fuzz *fuzz = data;
+    unsigned int bit = 1u << button;
+
+    if (is_press && (fuzz->pressed & bit)) {
+        fail(fuzz, PROPERTY_BUTTONS, "button %d pressed while down", button);
+    } else if (!is_press && !(fuzz->pressed & bit)) {
+        fail(fuzz, PROPERTY_BUTTONS, "button %d released while up", button);
+    }
+    fuzz->pressed = is_press ? fuzz->pressed | bit : fuzz->pressed & ~bit;
+}
+
+static void fuzz_scroll(void *data, double dx, double dy)
+{
+    struct Fuzz *fuzz = data;
+
+    if (!isfinite(dx) || !isfinite(dy) || fabs(dx) > MAX_SCROLL || fabs(dy) > MAX_SCROLL) {
+        fail(fuzz, PROPERTY_OUTPUT, "scroll %f %f", dx, dy);
+    }
+}
+
+static void check_idle(struct Fuzz *fuzz)
+{
+    if (fuzz->pressed) {
+        fail(fuzz, PROPERTY_IDLE, "buttons 0x%x still down", fuzz->pressed);
+    } else if (fuzz->state.touchpad_state != TS_DEFAULT) {
+        fail(fuzz, PROPERTY_IDLE, "still in state %s", touchpad_state_name(fuzz->state.touchpad_state));
+    } else if (fuzz->state.num_deadlines > 0) {
+        fail(fuzz, PROPERTY_IDLE, "%d timeouts still pending", fuzz->state.num_deadlines);
+    }
+}
+
+static void add_event(struct Fuzz *fuzz, const struct timeval *time, int type, int code, int value)
+{
+    struct input_event *ev = &fuzz->events[fuzz->count++];
+
+    ev->time = *time;
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+static void select_slot(struct Fuzz *fuzz, const struct timeval *time, int slot)
+{
+    if (fuzz->slot != slot) {
+        add_event(fuzz, time, EV_ABS, ABS_MT_SLOT, slot);
+        fuzz->slot = slot;
+    }
+}
+
+/* The events the kernel sends for 'frame', in its order: the slots that
+ * changed, the button, SYN_REPORT. Nothing if nothing changed. */
+static void encode_frame(struct Fuzz *fuzz, const struct FuzzFrame *frame, const struct timeval *time)
+{
+    const struct FuzzTouch *touches[FUZZ_SLOTS];
+    const struct FuzzTouch *cur;
+    struct FuzzTouch *prev;
+    int slot, i;
+
+    memset(touches, 0, sizeof(touches));
+    for (i = 0; i < frame->count; ++i) {
+        touches[frame->touches[i].slot] = &frame->touches[i];
+    }
+    fuzz->count = 0;
+    for (slot = 0; slot < FUZZ_SLOTS; ++slot) {
+        cur = touches[slot];
+        prev = &fuzz->slots[slot];
+        if (prev->id >= 0 && (!cur || cur->id != prev->id)) {
+            select_slot(fuzz, time, slot);
+            add_event(fuzz, time, EV_ABS, ABS_MT_TRACKING_ID, -1);
+            prev->id = -1;
+        }
+        if (!cur) {
+            continue;
+        }
+        if (prev->id < 0) {
+            select_slot(fuzz, time, slot);
+            add_event(fuzz, time, EV_ABS, ABS_MT_TRACKING_ID, cur->id);
+            add_event(fuzz, time, EV_ABS, ABS_MT_POSITION_X, cur->x);
+            add_event(fuzz, time, EV_ABS, ABS_MT_POSITION_Y, cur->y);
+        } else if (cur->x != prev->x || cur->y != prev->y) {
+            select_slot(fuzz, time, slot);
+            if (cur->x != prev->x) {
+                add_event(fuzz, time, EV_ABS, ABS_MT_POSITION_X, cur->x);
+            }
+            if (cur->y != prev->y) {
+                add_event(fuzz, time, EV_ABS, ABS_MT_POSITION_Y, cur->y);
+            }
+        }
+        *prev = *cur;
+    }
+    if (frame->button != fuzz->button) {
+        add_event(fuzz, time, EV_KEY, BTN_LEFT, frame->button);
+        fuzz->button = frame->button;
+    }
+    if (fuzz->count > 0) {
+        add_event(fuzz, time, EV_SYN, SYN_REPORT, 0);
+    }
+}
+
+static void record_event(FILE *out, const struct timeval *time, int type, int code, int value)
+{
+    fprintf(out, "E: %lu.%06lu %04x %04x %d\n", (unsigned long) time->tv_sec, (unsigned long) time->tv_usec,
+            type, code, value);
+}
+
+/* The device lost events, or was switched on again if 'resume', and
+ * reports 'frame' as its state now, which the driver reads back and resyncs
+ * the engine to. */
+static void resync(struct Fuzz *fuzz, const struct FuzzFrame *frame, struct timeval *time, int resume)
+{
+    struct GestureTouch touches[FUZZ_MAX_TOUCHES];
+    int slot, i;
+
+    for (slot = 0; slot < FUZZ_SLOTS; ++slot) {
+        fuzz->slots[slot].id = -1;
+    }
+    for (i = 0; i < frame->count; ++i) {
+        touches[i].slot_id = frame->touches[i].slot;
+        touches[i].x = frame->touches[i].x;
+        touches[i].y = frame->touches[i].y;
+        touches[i].pressure = frame->touches[i].pressure;
+        fuzz->slots[frame->touches[i].slot] = frame->touches[i];
+    }
+    fuzz->slot = frame->count > 0 ? frame->touches[frame->count - 1].slot : -1;
+    fuzz->button = frame->button;
+    if (fuzz->record) {
+        // the format random-record uses, see random-replay
+        record_event(fuzz->record, time, EV_SYN, SYN_DROPPED, 0);
+        fprintf(fuzz->record, "# resync: %d\n", fuzz->slot);
+        for (i = 0; i < frame->count; ++i) {
+            fprintf(fuzz->record, "# touch: %d %d %d %d\n", touches[i].slot_id, touches[i].x, touches[i].y,
+                    touches[i].pressure);
+        }
+        record_event(fuzz->record, time, EV_SYN, SYN_REPORT, 0);
+    }
+    if (resume) {
+        gesture_resume(&fuzz->state, time, touches, frame->count, fuzz->slot);
+    } else {
+        gesture_resync(&fuzz->state, time, touches, frame->count, fuzz->slot);
+    }
+}
+
+/* The device is switched off, the driver records that as a resync without
+ * touches. */
+static void suspend(struct Fuzz *fuzz, struct timeval *time)
+{
+    int slot;
+
+    for (slot = 0; slot < FUZZ_SLOTS; ++slot) {
+        fuzz->slots[slot].id = -1;
+    }
+    fuzz->slot = -1;
+    if (fuzz->record) {
+        record_event(fuzz->record, time, EV_SYN, SYN_DROPPED, 0);
+        fprintf(fuzz->record, "# resync: -1\n");
+        record_event(fuzz->record, time, EV_SYN, SYN_REPORT, 0);
+    }
+    gesture_suspend(&fuzz->state, time);
+    check_idle(fuzz);
+}
+
+static void read_frame(struct Fuzz *fuzz, const struct FuzzFrame *frame, struct timeval *time)
+{
+    int i;
+
+    encode_frame(fuzz, frame, time);
+    if (fuzz->count == 0) {
+        return;
+    }
+    if (fuzz->record) {
+        for (i = 0; i < fuzz->count; ++i) {
+            record_event(fuzz->record, time, fuzz->events[i].type, fuzz->events[i].code, fuzz->events[i].value);
+        }
+    }
+    gesture_coalesce_begin(&fuzz->state);
+    process_frame(&fuzz->state, fuzz->events, fuzz->count);
+    gesture_coalesce_end(&fuzz->state);
+}
+
+/* Runs the case through a fresh engine, like random-replay would run the
+ * recording of it, and writes that recording to 'record' if not NULL.
+ * Returns the first property that failed. */
+static enum Property run_case(struct Fuzz *fuzz, const struct Case *c, FILE *record, unsigned long long *usec)
+{
+    static const struct FuzzFrame lifted;
+    struct GestureSink sink;
+    struct GestureClock clock;
+    struct timeval time, gap;
+    const struct FuzzFrame *prev = &lifted;
+    int slot, i;
+
+    memset(fuzz, 0, sizeof(*fuzz));
+    fuzz->record = record;
+    fuzz->slot = -1;
+    for (slot = 0; slot < FUZZ_SLOTS; ++slot) {
+        fuzz->slots[slot].id = -1;
+    }
+    sink.motion = fuzz_motion;
+    sink.button = fuzz_button;
+    sink.scroll = fuzz_scroll;
+    sink.data = fuzz;
+    simclock_init(&fuzz->sim, &clock);
+    if (gesture_init(&fuzz->state, FUZZ_SLOTS, &sink, &clock) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    time.tv_sec = 1000;
+    time.tv_usec = 0;
+
+    for (i = 0; i <= c->count && fuzz->failed == PROPERTY_NONE; ++i) {
+        const struct FuzzFrame *frame = i < c->count ? &c->frames[i] : &lifted;
+
+        if (i == c->count && prev->count == 0 && !prev->button) {
+            break;
+        }
+        if (frame->suspended && !frame->dropped) {
+            suspend(fuzz, &time);
+        }
+        gap.tv_sec = frame->gap / 1000000;
+        gap.tv_usec = frame->gap % 1000000;
+        if (i == c->count) {
+            // a shrunk case may stop with fingers down, lift them
+            gap.tv_usec = 8000;
+        }
+        timeradd(&time, &gap, &time);
+        simclock_advance(&fuzz->sim, &fuzz->state, &time);
+        if (prev->count == 0 && !prev->button && frame->gap >= QUIET_USEC) {
+            check_idle(fuzz);
+        }
+        if (frame->dropped || frame->suspended) {
+            resync(fuzz, frame, &time, !frame->dropped);
+        } else {
+            read_frame(fuzz, frame, &time);
+        }
+        prev = frame;
+    }
+    if (fuzz->failed == PROPERTY_NONE) {
+        if (simclock_drain(&fuzz->sim, &fuzz->state, MAX_EXPIRIES) != 0) {
+            fail(fuzz, PROPERTY_TIMERS, "a timeout is still armed after %d expiries", MAX_EXPIRIES);
+        } else {
+            check_idle(fuzz);
+        }
+    }
+    if (usec) {
+        *usec += (fuzz->sim.now.tv_sec - 1000) * 1000000ULL + fuzz->sim.now.tv_usec;
+    }
+    gesture_free(&fuzz->state);
+    return fuzz->failed;
+}
+
+/* Drops runs of frames, halving their length down to single frames, as
+ * long as the case still breaks 'property'. */
+static void shrink(struct Fuzz *fuzz, struct Case *c, struct Case *trial, enum Property property)
+{
+    int chunk, i, n;
+
+    for (chunk = c->count / 2; chunk > 0; chunk /= 2) {
+        for (i = 0; i < c->count; ) {
+            n = chunk < c->count - i ? chunk : c->count - i;
+            memcpy(trial->frames, c->frames, i * sizeof(struct FuzzFrame));
+            memcpy(trial->frames + i, c->frames + i + n, (c->count - i - n) * sizeof(struct FuzzFrame));
+            trial->count = c->count - n;
+            if (run_case(fuzz, trial, NULL, NULL) == property) {
+                memcpy(c->frames, trial->frames, trial->count * sizeof(struct FuzzFrame));
+                c->count = trial->count;
+            } else {
+                i += n;
+            }
+        }
+    }
+}
+
+static int write_case(struct Fuzz *fuzz, const struct Case *c, const char *path, unsigned long long seed)
+{
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        return -1;
+    }
+    fprintf(out, "# random-record\n# name: random-fuzz -s %llu\n# slots: %d\n", seed, FUZZ_SLOTS);
+    run_case(fuzz, c, out, NULL);
+    return fclose(out);
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static struct Fuzz fuzz;
+    struct Case c, trial;
+    unsigned long long seed = 1, usec = 0;
+    unsigned long frames = 0;
+    const char *path = DEFAULT_OUTPUT;
+    int cases = DEFAULT_CASES, verbose = 0, i, opt;
+    enum Property property = PROPERTY_NONE;
+    double start;
+
+    while ((opt = getopt(argc, argv, "n:o:s:vh")) != -1) {
+        switch (opt) {
+            case 'n':
+            cases = atoi(optarg);
+            break;
+            case 'o':
+            path = optarg;
+            break;
+            case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+            case 'v':
+            verbose = 1;
+            break;
+            default:
+            fprintf(stderr, "Usage: %s [-n cases] [-o file] [-s seed] [-v]\n"
+                            "  -n  number of cases, %d by default\n"
+                            "  -o  where a failing case goes, %s by default\n"
+                            "  -s  seed of the first case, the next ones count up\n"
+                            "  -v  print every case\n", argv[0], DEFAULT_CASES, DEFAULT_OUTPUT);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    c.frames = calloc(FUZZ_MAX_FRAMES, sizeof(struct FuzzFrame));
+    trial.frames = calloc(FUZZ_MAX_FRAMES, sizeof(struct FuzzFrame));
+    if (!c.frames || !trial.frames) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    start = seconds();
+    for (i = 0; i < cases && property == PROPERTY_NONE; ++i) {
+        generate(&c, seed + i);
+        frames += c.count;
+        property = run_case(&fuzz, &c, NULL, &usec);
+        if (verbose) {
+            printf("case %llu: %d frames, %s\n", seed + i, c.count,
+                   property == PROPERTY_NONE ? "ok" : fuzz.message);
+        }
+    }
+    if (property != PROPERTY_NONE) {
+        printf("case %llu failed at %s\n", seed + i - 1, fuzz.message);
+        shrink(&fuzz, &c, &trial, property);
+        run_case(&fuzz, &c, NULL, NULL);
+        printf("shrunk to %d frames, failing at %s\n", c.count, fuzz.message);
+        if (write_case(&fuzz, &c, path, seed + i - 1) != 0) {
+            fprintf(stderr, "Cannot write %s\n", path);
+        } else {
+            printf("written to %s, see random-replay\n", path);
+        }
+    }
+    printf("%d cases, %lu frames, %.1f hours of input in %.2f s\n", i, frames, usec / 3.6e9, seconds() - start);
+
+    free(c.frames);
+    free(trial.frames);
+    return property == PROPERTY_NONE ? 0 : 1;
+}
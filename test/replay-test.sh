@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Replays every recording in $TRACES through $REPLAY and compares the posted
+# events against the golden output next to it. The flight recorder snapshot
+# of every replay has to replay to the same output.
+
+: ${srcdir:=.}
+: ${REPLAY:=../tools/random-replay}
+
+status=0
+for trace in $TRACES; do
+    actual=`basename $trace`.out
+    recording=`basename $trace`.rec
+    if ! $REPLAY -f $recording $srcdir/$trace.events $actual; then
+        echo "FAIL: $trace: replay failed"
+        status=1
+        continue
+    fi
+    if ! diff -u $srcdir/$trace.expected $actual; then
+        echo "FAIL: $trace"
+        status=1
+        continue
+    fi
+    # the snapshot does not know the read interval of the recording
+    interval=`sed -n 's/^# read-interval: //p' $srcdir/$trace.events`
+    if $REPLAY ${interval:+-r $interval} $recording $actual &&
+       diff -u $srcdir/$trace.expected $actual; then
+        echo "PASS: $trace"
+        rm -f $actual $recording
+    else
+        echo "FAIL: $trace: flight recorder snapshot"
+        status=1
+    fi
+done
+exit $status
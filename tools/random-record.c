@@ -0,0 +1,177 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Records the raw input_event stream of a touchpad into a text file that
+ * random-replay can play back:
+ *
+ *     random-record /dev/input/event8 > scroll-lag.events
+ *
+ * Every event is one line: "E: <sec>.<usec> <type> <code> <value>" with type
+ * and code in hex, the same layout evemu-record uses. The header records
+ * the number of touch slots for random-replay. When the kernel drops events
+ * (SYN_DROPPED) the touches are read back from the device, like the driver
+ * does, and written after it as "# resync:" and "# touch:" lines. Stop with
+ * Ctrl-C.
+ */
+
+#include <linux/input.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int sig)
+{
+    stop = 1;
+}
+
+/* Writes the MT state of the device, what the driver resyncs to after a
+ * SYN_DROPPED. The pressure is ABS_PRESSURE, like the driver's. */
+static void write_resync(FILE *out, int fd, int num_slots)
+{
+    static const int codes[3] = { ABS_MT_TRACKING_ID, ABS_MT_POSITION_X, ABS_MT_POSITION_Y };
+    struct input_absinfo slot, pressure;
+    int32_t *rows[3];
+    int i;
+
+    if (ioctl(fd, EVIOCGABS(ABS_MT_SLOT), &slot) < 0) {
+        slot.value = -1;
+    }
+    if (ioctl(fd, EVIOCGABS(ABS_PRESSURE), &pressure) < 0) {
+        pressure.value = 0;
+    }
+    fprintf(out, "# resync: %d\n", slot.value);
+    for (i = 0; i < 3; i++) {
+        rows[i] = calloc(num_slots + 1, sizeof(int32_t));
+        if (rows[i]) {
+            rows[i][0] = codes[i];
+            ioctl(fd, EVIOCGMTSLOTS((num_slots + 1) * sizeof(int32_t)), rows[i]);
+        }
+    }
+    for (i = 0; rows[0] && rows[1] && rows[2] && i < num_slots; i++) {
+        if (rows[0][i + 1] >= 0) {
+            fprintf(out, "# touch: %d %d %d %d\n", i, rows[1][i + 1], rows[2][i + 1], pressure.value);
+        }
+    }
+    for (i = 0; i < 3; i++) {
+        free(rows[i]);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-g] <device> [output]\n"
+                    "  -g  grab the device, so X does not see the events while recording\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    struct input_event events[64];
+    struct sigaction sa;
+    struct input_absinfo slots;
+    char name[256] = "unknown";
+    const char *device;
+    FILE *out = stdout;
+    int grab = 0, num_slots = 0;
+    int fd, opt, i;
+    ssize_t len;
+
+    while ((opt = getopt(argc, argv, "gh")) != -1) {
+        switch (opt) {
+            case 'g':
+            grab = 1;
+            break;
+            default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    device = argv[optind];
+
+    fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", device, strerror(errno));
+        return 1;
+    }
+    if (optind + 1 < argc) {
+        out = fopen(argv[optind + 1], "w");
+        if (!out) {
+            fprintf(stderr, "Cannot open %s: %s\n", argv[optind + 1], strerror(errno));
+            close(fd);
+            return 1;
+        }
+    }
+    if (grab && ioctl(fd, EVIOCGRAB, (void *) 1) < 0) {
+        fprintf(stderr, "Cannot grab %s: %s\n", device, strerror(errno));
+    }
+    ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    fprintf(out, "# random-record\n# device: %s\n# name: %s\n", device, name);
+    if (ioctl(fd, EVIOCGABS(ABS_MT_SLOT), &slots) == 0) {
+        num_slots = slots.maximum + 1;
+        fprintf(out, "# slots: %d\n", num_slots);
+    }
+    fflush(out);
+    while (!stop) {
+        len = read(fd, events, sizeof(events));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Cannot read %s: %s\n", device, strerror(errno));
+            break;
+        }
+        for (i = 0; i < len / (ssize_t) sizeof(struct input_event); ++i) {
+            fprintf(out, "E: %lu.%06lu %04x %04x %d\n",
+                    (unsigned long) events[i].time.tv_sec, (unsigned long) events[i].time.tv_usec,
+                    events[i].type, events[i].code, events[i].value);
+            if (events[i].type == EV_SYN && events[i].code == SYN_DROPPED && num_slots > 0) {
+                write_resync(out, fd, num_slots);
+            }
+        }
+        fflush(out);
+    }
+
+    if (grab) {
+        ioctl(fd, EVIOCGRAB, (void *) 0);
+    }
+    close(fd);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
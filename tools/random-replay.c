@@ -0,0 +1,395 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Plays a file written by random-record through the gesture engine and
+ * prints what the driver would post to the X server, one line per call:
+ *
+ *     <sec>.<usec> motion <dx> <dy>
+ *     <sec>.<usec> button <button> press|release
+ *     <sec>.<usec> scroll <dx> <dy>
+ *
+ * Time is virtual (simclock.h): the clock follows the event timestamps and a pending
+ * timeout fires as soon as the next frame is past its deadline, so the
+ * output only depends on the input file. Events are collected up to their
+ * SYN_REPORT and passed on with process_frame(), like the driver does. A
+ * SYN_DROPPED resyncs the engine to the "# touch:" lines random-record wrote
+ * after it and skips the rest of its frame.
+ *
+ * With -m the events the driver has the kernel mask out are dropped, and so
+ * are the frames left empty by that, as the kernel does.
+ *
+ * With -r <msec> (or a "# read-interval:" line in the recording) the frames
+ * are read like by a server that only gets to the device every <msec>
+ * milliseconds: everything that arrived in between is processed in one go
+ * at the next multiple of <msec>, with the output coalesced as the driver
+ * does. Without it every frame is read on its own when it arrives.
+ *
+ * With -s <file> the engine counts its statistics into <file> like the
+ * driver does, for random-stats. The file stays after the replay.
+ *
+ * With -t <file> everything is traced and the trace ring is written to
+ * <file> at the end, for random-trace.
+ */
+
+#include <linux/input.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "gesture.h"
+#include "recorder.h"
+#include "simclock.h"
+
+/* stop draining timers at the end of the file after this many expiries */
+#define MAX_TRAILING_TIMERS 100000
+
+/* used when the recording has no "# slots:" line, bcm5974 has 16 slots */
+#define DEFAULT_SLOTS 16
+
+/* the flight recorder of -f holds this many bytes, all of the usual recording */
+#define RECORDER_SIZE (1024 * 1024)
+
+/* most events read in one go; the driver reads until the device is empty,
+ * so this only has to be big enough for the longest stall replayed */
+#define MAX_READ_EVENTS 8192
+
+struct Replay {
+    FILE *out;
+    struct SimClock sim;
+    // SYN_DROPPED handling
+    int resync_pending;
+    int skip_frame;
+    struct timeval resync_time;
+    int resync_slot;
+    struct GestureTouch *touches;
+    int num_touches;
+    // events not read yet, the first 'complete' of them end with a SYN_REPORT
+    struct input_event events[MAX_READ_EVENTS];
+    int count;
+    int complete;
+    unsigned long read_interval; // usec, 0 reads every frame when it arrives
+    struct timeval read_at;
+    struct Recorder recorder; // of -f, off without it
+};
+
+static void replay_motion(void *data, int dx, int dy)
+{
+    struct Replay *replay = data;
+
+    fprintf(replay->out, "%lu.%06lu motion %d %d\n",
+            (unsigned long) replay->sim.now.tv_sec, (unsigned long) replay->sim.now.tv_usec, dx, dy);
+}
+
+static void replay_button(void *data, int button, int is_press)
+{
+    struct Replay *replay = data;
+
+    fprintf(replay->out, "%lu.%06lu button %d %s\n",
+            (unsigned long) replay->sim.now.tv_sec, (unsigned long) replay->sim.now.tv_usec,
+            button, is_press ? "press" : "release");
+}
+
+static void replay_scroll(void *data, double dx, double dy)
+{
+    struct Replay *replay = data;
+
+    fprintf(replay->out, "%lu.%06lu scroll %.3f %.3f\n",
+            (unsigned long) replay->sim.now.tv_sec, (unsigned long) replay->sim.now.tv_usec, dx, dy);
+}
+
+/* Processes the complete frames like one RandomReadInput() at 'time' and
+ * keeps the rest for the next read. */
+static void replay_read(struct Replay *replay, struct State *state, struct timeval *time)
+{
+    struct timeval read_time = *time;
+
+    simclock_advance(&replay->sim, state, &read_time);
+    gesture_coalesce_begin(state);
+    process_frame(state, replay->events, replay->complete);
+    gesture_coalesce_end(state);
+    replay->count -= replay->complete;
+    memmove(replay->events, replay->events + replay->complete, replay->count * sizeof(struct input_event));
+    replay->complete = 0;
+}
+
+/* the first multiple of the read interval after 'time' */
+static void next_read(struct Replay *replay, struct timeval *time)
+{
+    unsigned long long usec = time->tv_sec * 1000000ULL + time->tv_usec;
+
+    usec = (usec / replay->read_interval + 1) * replay->read_interval;
+    replay->read_at.tv_sec = usec / 1000000;
+    replay->read_at.tv_usec = usec % 1000000;
+}
+
+static void add_event(struct Replay *replay, struct State *state, struct timeval *time, int type, int code, int value)
+{
+    struct input_event *ev;
+
+    if (replay->read_interval > 0 && replay->complete > 0 && !timercmp(time, &replay->read_at, <)) {
+        replay_read(replay, state, &replay->read_at);
+    }
+    ev = &replay->events[replay->count++];
+    ev->time = *time;
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+    if (type == EV_SYN && code == SYN_REPORT) {
+        if (replay->read_interval > 0 && replay->complete == 0) {
+            next_read(replay, time);
+        }
+        replay->complete = replay->count;
+    }
+    if ((replay->read_interval == 0 && replay->complete > 0) || replay->count == MAX_READ_EVENTS) {
+        // a stall longer than the buffer is read in pieces
+        replay->complete = replay->count;
+        replay_read(replay, state, time);
+    }
+}
+
+static void replay_resync(struct Replay *replay, struct State *state)
+{
+    simclock_advance(&replay->sim, state, &replay->resync_time);
+    gesture_resync(state, &replay->resync_time, replay->touches, replay->num_touches, replay->resync_slot);
+    recorder_add_resync(&replay->recorder, replay->touches, replay->num_touches, replay->resync_slot);
+    replay->resync_pending = 0;
+    replay->num_touches = 0;
+}
+
+static int write_trace(struct State *state, const char *path)
+{
+    FILE *out = fopen(path, "wb");
+    int res;
+
+    if (!out) {
+        return -1;
+    }
+    res = trace_dump(&state->trace, out);
+    return fclose(out) == 0 ? res : -1;
+}
+
+static int write_recording(struct Recorder *recorder, const char *path, const char *recording)
+{
+    FILE *out = fopen(path, "w");
+    int res;
+
+    if (!out) {
+        return -1;
+    }
+    res = recorder_write(recorder, out, recording);
+    return fclose(out) == 0 ? res : -1;
+}
+
+int main(int argc, char **argv)
+{
+    static struct State state;
+    static struct Replay replay;
+    struct GestureSink sink;
+    struct GestureClock clock;
+    char line[256];
+    unsigned long sec, usec;
+    unsigned int type, code;
+    int value, lineno = 0;
+    struct GestureTouch touch;
+    struct timeval time;
+    int num_slots = DEFAULT_SLOTS, initialized = 0;
+    int masked = 0, read_interval = -1, accel_profile = ACCEL_PROFILE_ADAPTIVE, opt;
+    const char *path, *stats_path = NULL, *trace_path = NULL, *recorder_path = NULL;
+    struct GestureStats *stats;
+    struct input_event ev;
+    FILE *in;
+
+    while ((opt = getopt(argc, argv, "a:f:mr:s:t:h")) != -1) {
+        switch (opt) {
+            case 'a':
+            accel_profile = accel_profile_from_name(optarg);
+            if (accel_profile < 0) {
+                fprintf(stderr, "Unknown acceleration profile %s\n", optarg);
+                return 1;
+            }
+            break;
+            case 'f':
+            recorder_path = optarg;
+            break;
+            case 'm':
+            masked = 1;
+            break;
+            case 'r':
+            read_interval = atoi(optarg);
+            break;
+            case 's':
+            stats_path = optarg;
+            break;
+            case 't':
+            trace_path = optarg;
+            break;
+            default:
+            fprintf(stderr, "Usage: %s [-a profile] [-f file] [-m] [-r msec] [-s file] [-t file] <recording> [output]\n"
+                            "  -a  pointer acceleration: adaptive (default), linear or flat\n"
+                            "  -f  pass the events through the flight recorder and write it to file\n"
+                            "  -m  drop the events the kernel event mask of the driver drops\n"
+                            "  -r  read the device only every msec milliseconds\n"
+                            "  -s  count statistics into file, see random-stats\n"
+                            "  -t  write a full trace to file, see random-trace\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || optind + 2 < argc) {
+        fprintf(stderr, "Usage: %s [-a profile] [-f file] [-m] [-r msec] [-s file] [-t file] <recording> [output]\n", argv[0]);
+        return 1;
+    }
+    path = argv[optind];
+    in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    memset(&replay, 0, sizeof(replay));
+    replay.out = stdout;
+    if (optind + 1 < argc) {
+        replay.out = fopen(argv[optind + 1], "w");
+        if (!replay.out) {
+            fprintf(stderr, "Cannot open %s: %s\n", argv[optind + 1], strerror(errno));
+            fclose(in);
+            return 1;
+        }
+    }
+
+    sink.motion = replay_motion;
+    sink.button = replay_button;
+    sink.scroll = replay_scroll;
+    sink.data = &replay;
+    simclock_init(&replay.sim, &clock);
+
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        if (line[0] == '#') {
+            if (!initialized) {
+                sscanf(line, "# slots: %d", &num_slots);
+                if (read_interval < 0) {
+                    sscanf(line, "# read-interval: %d", &read_interval);
+                }
+            } else if (replay.resync_pending) {
+                sscanf(line, "# resync: %d", &replay.resync_slot);
+                if (sscanf(line, "# touch: %d %d %d %d", &touch.slot_id, &touch.x, &touch.y, &touch.pressure) == 4 &&
+                    replay.num_touches < num_slots) {
+                    replay.touches[replay.num_touches++] = touch;
+                }
+            }
+            continue;
+        }
+        if (line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "E: %lu.%lu %x %x %d", &sec, &usec, &type, &code, &value) != 5) {
+            fprintf(stderr, "%s:%d: cannot parse line\n", path, lineno);
+            continue;
+        }
+        if (!initialized) {
+            replay.touches = calloc(num_slots > 0 ? num_slots : 1, sizeof(struct GestureTouch));
+            if (!replay.touches || gesture_init(&state, num_slots, &sink, &clock) != 0) {
+                fprintf(stderr, "Cannot allocate %d slots\n", num_slots);
+                return 1;
+            }
+            gesture_set_accel_profile(&state, accel_profile);
+            if (stats_path) {
+                stats = stats_create(stats_path);
+                if (!stats) {
+                    fprintf(stderr, "Cannot create %s: %s\n", stats_path, strerror(errno));
+                    return 1;
+                }
+                gesture_set_stats(&state, stats);
+            }
+            if (trace_path) {
+                trace_set_level(&state.trace, TRACE_LEVEL_EVENTS);
+            }
+            if (recorder_path && recorder_init(&replay.recorder, num_slots, RECORDER_SIZE, 0) != 0) {
+                fprintf(stderr, "Cannot allocate the flight recorder\n");
+                return 1;
+            }
+            replay.read_interval = read_interval > 0 ? read_interval * 1000UL : 0;
+            initialized = 1;
+        }
+        if (replay.resync_pending) {
+            replay_resync(&replay, &state);
+        }
+        time.tv_sec = sec;
+        time.tv_usec = usec;
+        // the driver records everything it reads, before the kernel mask
+        ev.time = time;
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        recorder_add(&replay.recorder, &ev);
+        if (type == EV_SYN && code == SYN_DROPPED) {
+            // the frames before it are read first, the incomplete one is lost
+            replay.count = replay.complete;
+            if (replay.complete > 0) {
+                replay_read(&replay, &state, &time);
+            }
+            replay.resync_pending = 1;
+            replay.skip_frame = 1;
+            replay.resync_time = time;
+            replay.resync_slot = -1;
+            continue;
+        }
+        if (replay.skip_frame) {
+            replay.skip_frame = !(type == EV_SYN && code == SYN_REPORT);
+            continue;
+        }
+        if (masked && (!gesture_wants_event(&state, type, code) ||
+                       (type == EV_SYN && code == SYN_REPORT && replay.count == replay.complete))) {
+            continue;
+        }
+        add_event(&replay, &state, &time, type, code, value);
+    }
+    if (initialized) {
+        if (replay.resync_pending) {
+            replay_resync(&replay, &state);
+        }
+        if (replay.count > 0) {
+            time = replay.read_interval > 0 && replay.complete > 0 ? replay.read_at : replay.events[replay.count - 1].time;
+            replay.complete = replay.count;
+            replay_read(&replay, &state, &time);
+        }
+        if (simclock_drain(&replay.sim, &state, MAX_TRAILING_TIMERS) != 0) {
+            fprintf(stderr, "Timer is still armed after %d expiries, giving up\n", MAX_TRAILING_TIMERS);
+        }
+        if (trace_path && write_trace(&state, trace_path) != 0) {
+            fprintf(stderr, "Cannot write %s\n", trace_path);
+        }
+        if (recorder_path && write_recording(&replay.recorder, recorder_path, path) != 0) {
+            fprintf(stderr, "Cannot write %s\n", recorder_path);
+        }
+        recorder_free(&replay.recorder);
+        gesture_free(&state);
+        free(replay.touches);
+    }
+
+    fclose(in);
+    if (replay.out != stdout) {
+        fclose(replay.out);
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Shows the live statistics of the driver, from the file it keeps them in
+ * (Option "StatsFile", /dev/shm/random-stats-<device> by default):
+ *
+ *     random-stats                      every second, what changed since the last sample
+ *     random-stats -1 /dev/shm/random-stats-event8   the totals since X started
+ *
+ * It only maps the file, the X server does not notice. Latencies are the
+ * time from the kernel's event timestamp to the call that posts the
+ * result, shown as the histogram bucket they fall into.
+ */
+
+#include <errno.h>
+#include <glob.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gesture.h"
+#include "stats.h"
+
+#define DEFAULT_PATTERN "/dev/shm/random-stats-*"
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int sig)
+{
+    stop = 1;
+}
+
+/* Copies the counters, each one read atomically. */
+static void take_sample(const struct GestureStats *stats, struct GestureStats *sample)
+{
+    const uint64_t *from = &stats->started;
+    uint64_t *to = &sample->started;
+    size_t i, n = (sizeof(struct GestureStats) - offsetof(struct GestureStats, started)) / sizeof(uint64_t);
+
+    for (i = 0; i < n; i++) {
+        to[i] = stats_load(&from[i]);
+    }
+}
+
+/* diff = now - then, counter by counter */
+static void subtract_sample(struct GestureStats *diff, const struct GestureStats *now, const struct GestureStats *then)
+{
+    const uint64_t *a = &now->started, *b = &then->started;
+    uint64_t *to = &diff->started;
+    size_t i, n = (sizeof(struct GestureStats) - offsetof(struct GestureStats, started)) / sizeof(uint64_t);
+
+    for (i = 0; i < n; i++) {
+        to[i] = a[i] - b[i];
+    }
+}
+
+/* Upper limit of the bucket the p-th fraction of the values is in, 0 if
+ * there are none. */
+static uint64_t percentile(const struct StatsHistogram *histogram, double p)
+{
+    uint64_t seen = 0;
+    int i;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+    for (i = 0; i < STATS_BUCKETS - 1; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= p * histogram->count) {
+            return stats_bucket_limit(i);
+        }
+    }
+    return UINT64_MAX;
+}
+
+static void print_percentile(const char *name, const struct StatsHistogram *histogram, double p)
+{
+    uint64_t limit = percentile(histogram, p);
+
+    if (limit == UINT64_MAX) {
+        printf(" %s >=%llu", name, (unsigned long long) stats_bucket_limit(STATS_BUCKETS - 2));
+    } else {
+        printf(" %s <%llu", name, (unsigned long long) limit);
+    }
+}
+
+static void print_histogram(const char *name, const struct StatsHistogram *histogram)
+{
+    printf("%-16s", name);
+    if (histogram->count == 0) {
+        printf(" -\n");
+        return;
+    }
+    printf(" avg %.1f", (double) histogram->sum / histogram->count);
+    print_percentile("p50", histogram, 0.5);
+    print_percentile("p99", histogram, 0.99);
+    print_percentile("max", histogram, 1.0);
+    printf("\n");
+}
+
+/* 'seconds' is the length of the sample, 0 for the totals. */
+static void print_sample(const struct GestureStats *sample, double seconds)
+{
+    uint64_t total_usec = 0;
+    int i;
+
+    if (seconds > 0) {
+        printf("frames/s %8.1f   events/s %8.1f   posted/s %8.1f   momentum ticks/s %6.1f\n",
+               sample->frames / seconds, sample->events / seconds,
+               sample->posted / seconds, sample->momentum_ticks / seconds);
+    } else {
+        printf("frames %llu   events %llu   posted %llu   momentum ticks %llu\n",
+               (unsigned long long) sample->frames, (unsigned long long) sample->events,
+               (unsigned long long) sample->posted, (unsigned long long) sample->momentum_ticks);
+    }
+    printf("syn_dropped %llu\n", (unsigned long long) sample->syn_dropped);
+    print_histogram("events/frame", &sample->events_per_frame);
+    print_histogram("latency usec", &sample->latency_usec);
+    for (i = 0; i < STATS_STATES; i++) {
+        total_usec += sample->state_usec[i];
+    }
+    for (i = 0; i < TS_NUM_STATES; i++) {
+        printf("  %-30s entered %8llu   %5.1f%% of the time\n", touchpad_state_name(i),
+               (unsigned long long) sample->state_entries[i],
+               total_usec ? 100.0 * sample->state_usec[i] / total_usec : 0.0);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-1] [-i seconds] [file]\n"
+                    "  -1  print the totals once and exit\n"
+                    "  -i  seconds between two samples, 1 by default\n"
+                    "The file defaults to the first %s\n", name, DEFAULT_PATTERN);
+}
+
+int main(int argc, char **argv)
+{
+    const struct GestureStats *stats;
+    struct GestureStats then, now, diff;
+    struct sigaction sa;
+    glob_t matches;
+    char *path = NULL;
+    double interval = 1.0;
+    int once = 0, opt;
+
+    while ((opt = getopt(argc, argv, "1i:h")) != -1) {
+        switch (opt) {
+            case '1':
+            once = 1;
+            break;
+            case 'i':
+            interval = atof(optarg);
+            if (interval <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+            default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind + 1 < argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (optind < argc) {
+        path = strdup(argv[optind]);
+    } else if (glob(DEFAULT_PATTERN, 0, NULL, &matches) == 0) {
+        path = strdup(matches.gl_pathv[0]);
+        globfree(&matches);
+    } else {
+        fprintf(stderr, "No %s, is the driver running?\n", DEFAULT_PATTERN);
+        return 1;
+    }
+    stats = path ? stats_open(path) : NULL;
+    if (!stats) {
+        fprintf(stderr, "Cannot read the statistics in %s\n", path ? path : DEFAULT_PATTERN);
+        free(path);
+        return 1;
+    }
+    if (kill(stats->pid, 0) != 0 && errno == ESRCH) {
+        fprintf(stderr, "%s: the writer (pid %u) is gone, these are its last values\n", path, stats->pid);
+    }
+
+    take_sample(stats, &now);
+    if (once) {
+        print_sample(&now, 0);
+        stats_close(stats);
+        free(path);
+        return 0;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("%s, pid %u\n", path, stats->pid);
+    while (!stop) {
+        then = now;
+        usleep(interval * 1000000);
+        if (stop) {
+            break;
+        }
+        take_sample(stats, &now);
+        subtract_sample(&diff, &now, &then);
+        printf("\n");
+        print_sample(&diff, interval);
+        fflush(stdout);
+    }
+    stats_close(stats);
+    free(path);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation.  The authors make no
+ * representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied
+ * warranty.
+ *
+ * THE AUTHORS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Decodes a trace the driver wrote (xinput set-prop <device> "Random Trace
+ * Dump" 1, see Option "TraceFile") or random-replay -t did, one record per
+ * line:
+ *
+ *     random-trace /var/tmp/random-trace-event8
+ *
+ * How much the trace holds depends on the level it was recorded at, see
+ * enum TraceLevel.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gesture.h"
+#include "trace.h"
+
+static const char *const timer_names[GESTURE_NUM_TIMERS] = {
+    [GESTURE_TIMER_DRAG_RELEASE] = "drag-release",
+    [GESTURE_TIMER_SCROLL_MOMENTUM] = "scroll-momentum",
+    [GESTURE_TIMER_SCROLL_RELEASE] = "scroll-release",
+};
+
+static void print_record(const struct TraceRecord *record, char **strings, uint32_t num_strings)
+{
+    const int32_t *v = record->v;
+
+    printf("%llu.%06llu %-10s", (unsigned long long) (record->time / 1000000),
+           (unsigned long long) (record->time % 1000000), trace_type_name(record->type));
+    switch (record->type) {
+        case TRACE_STATE:
+        printf(" %s -> %s", touchpad_state_name(v[0]), touchpad_state_name(v[1]));
+        if (v[2] >= 0 && (uint32_t) v[2] < num_strings) {
+            printf(" (%s)", strings[v[2]]);
+        }
+        break;
+        case TRACE_RESYNC:
+        printf(" %d touches, resync #%d", v[0], v[1]);
+        break;
+        case TRACE_SLOT_RANGE:
+        printf(" ABS_MT_SLOT %d, the device has %d slots", v[0], v[1]);
+        break;
+        case TRACE_MOMENTUM:
+        case TRACE_SCROLL:
+        printf(" %.3f %.3f", v[0] / 1000.0, v[1] / 1000.0);
+        break;
+        case TRACE_MOTION:
+        printf(" %d %d", v[0], v[1]);
+        break;
+        case TRACE_BUTTON:
+        printf(" %d %s", v[0], v[1] ? "press" : "release");
+        break;
+        case TRACE_FRAME:
+        printf(" %d active (%d before) %s", v[0], v[1], touchpad_state_name(v[2]));
+        break;
+        case TRACE_SLOT:
+        printf(" %d at %d:%d pressure %d for %d ms", record->id, v[0], v[1], v[2], v[3]);
+        break;
+        case TRACE_TIMER:
+        printf(" %s", v[0] >= 0 && v[0] < GESTURE_NUM_TIMERS ? timer_names[v[0]] : "unknown");
+        break;
+        case TRACE_EVENT:
+        printf(" %s (%04x %04x) %d", type_and_code_name(v[0], v[1]), v[0], v[1], v[2]);
+        break;
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct TraceFileHeader header;
+    struct TraceRecord record;
+    char *strings_data = NULL, **strings = NULL, *p;
+    uint32_t i;
+    FILE *in;
+    int status = 1;
+
+    if (argc != 2 || strcmp(argv[1], "-h") == 0) {
+        fprintf(stderr, "Usage: %s <trace>\n", argv[0]);
+        return argc == 2 ? 0 : 1;
+    }
+    in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "Cannot open %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != TRACE_MAGIC) {
+        fprintf(stderr, "%s is not a trace\n", argv[1]);
+        goto out;
+    }
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(struct TraceRecord)) {
+        fprintf(stderr, "%s: trace version %u is not supported\n", argv[1], header.version);
+        goto out;
+    }
+    strings_data = malloc(header.strings_size + 1);
+    strings = calloc(header.num_strings + 1, sizeof(char *));
+    if (!strings_data || !strings ||
+        (header.strings_size > 0 && fread(strings_data, header.strings_size, 1, in) != 1)) {
+        fprintf(stderr, "%s: cannot read the strings\n", argv[1]);
+        goto out;
+    }
+    strings_data[header.strings_size] = '\0';
+    for (i = 0, p = strings_data; i < header.num_strings && p < strings_data + header.strings_size; i++) {
+        strings[i] = p;
+        p += strlen(p) + 1;
+    }
+    header.num_strings = i;
+    for (i = 0; i < header.num_records; i++) {
+        if (fread(&record, sizeof(record), 1, in) != 1) {
+            fprintf(stderr, "%s: truncated after %u records\n", argv[1], i);
+            goto out;
+        }
+        print_record(&record, strings, header.num_strings);
+    }
+    status = 0;
+out:
+    free(strings);
+    free(strings_data);
+    fclose(in);
+    return status;
+}